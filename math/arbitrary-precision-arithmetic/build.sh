@@ -0,0 +1,6 @@
+#!/bin/bash
+
+mkdir -p build/
+gcc -O2 -pthread main.c -o build/bignum
+gcc -O2 -pthread -DTEST main.c -o build/test
+gcc -O2 -pthread -DBENCHMARK main.c -o build/benchmark
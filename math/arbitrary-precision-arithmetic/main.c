@@ -1,13 +1,45 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Numbers are stored as little-endian arrays of 64-bit limbs (base 2^64).
+// Decimal text only exists at the edges, in parse_number() and
+// number_to_string().
+typedef uint64_t Limb;
+typedef unsigned __int128 DoubleLimb;
+
+#define LIMB_BITS 64
+
+// Largest power of ten that fits in a limb, used to move between bases
+#define DECIMAL_BASE 10000000000000000000ULL
+#define DECIMAL_DIGITS 19
+
+// Values are kept in sign-magnitude form. Zero has no limbs and is never
+// negative.
+//
+// A zeroed Number, (Number){0}, is a valid zero with no buffer. The *_into()
+// and *_assign() operations grow the buffer as needed and otherwise reuse
+// it.
 typedef struct {
-  int length;
-  char *digits;
+  int length;   // Limbs in use, the most significant limb is never zero
+  int capacity; // Limbs allocated
+  bool negative;
+  Limb *limbs;
 } Number;
 
-char *allocate_string(int length) {
+// Every heap allocation made for limbs by this thread, so callers can check
+// that a warmed up chain of operations no longer allocates
+_Thread_local long allocations = 0;
+
+char *allocate_string(size_t length) {
   char *str = (char *)malloc(length * sizeof(char));
   if (str == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
@@ -16,88 +48,2696 @@ char *allocate_string(int length) {
   return str;
 }
 
-Number create_number(const char *str) {
-  Number number;
-  number.length = strlen(str);
-  number.digits = allocate_string(number.length + 1);
-  strcpy(number.digits, str);
-  return number;
+Limb *allocate_limbs(int length) {
+  // Zero is represented with no limbs, but malloc(0) may return NULL
+  Limb *limbs = (Limb *)malloc((length > 0 ? length : 1) * sizeof(Limb));
+  if (limbs == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  allocations++;
+  return limbs;
 }
 
-void free_number(Number number) {
-  free(number.digits);
-  number.digits = NULL;
-  number.length = 0;
+// Grows the buffer of number to at least capacity limbs, keeping its value.
+// The buffer may move, so callers that hold an operand sharing it have to
+// repoint that operand afterwards.
+void reserve(Number *number, int capacity) {
+  if (number->capacity >= capacity) {
+    return;
+  }
+
+  // Grow geometrically so a slowly growing accumulator reallocates rarely
+  if (capacity < number->capacity * 2) {
+    capacity = number->capacity * 2;
+  }
+
+  Limb *limbs = (Limb *)realloc(number->limbs, capacity * sizeof(Limb));
+  if (limbs == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  allocations++;
+  number->limbs = limbs;
+  number->capacity = capacity;
 }
 
-Number add(Number a, Number b) {
-  int maxLength = (a.length > b.length) ? a.length : b.length;
-  Number result;
-  result.length = maxLength + 1;
-  result.digits = allocate_string(result.length + 1);
-  result.digits[result.length] = '\0';
+// Scratch memory for the temporaries of the limb kernels. Allocation bumps
+// a pointer and arena_release() rolls back to an earlier mark. Blocks are
+// kept once allocated, so after warm-up the kernels allocate nothing.
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  int capacity;
+  int used;
+  Limb limbs[];
+} ArenaBlock;
+
+typedef struct {
+  ArenaBlock *first;
+  ArenaBlock *current;
+} Arena;
 
-  int carry = 0;
+typedef struct {
+  ArenaBlock *block;
+  int used;
+} ArenaMark;
+
+#define ARENA_MIN_BLOCK 4096
 
-  for (int i = 0; i < maxLength; i++) {
-    int digitA = (i < a.length) ? a.digits[a.length - 1 - i] - '0' : 0;
-    int digitB = (i < b.length) ? b.digits[b.length - 1 - i] - '0' : 0;
+// One arena per thread, shared by every kernel
+_Thread_local Arena scratch;
 
-    int sum = digitA + digitB + carry;
-    result.digits[result.length - 2 - i] = (sum % 10) + '0';
-    carry = sum / 10;
+Limb *arena_alloc(Arena *arena, int length) {
+  ArenaBlock *block = arena->current;
+  if (block != NULL && block->capacity - block->used >= length) {
+    Limb *limbs = block->limbs + block->used;
+    block->used += length;
+    return limbs;
   }
 
-  if (carry > 0) {
-    result.digits[0] = carry + '0';
-  } else {
-    result.length--;
-    for (int i = 0; i < result.length; i++) {
-      result.digits[i] = result.digits[i + 1];
+  // Move on to the next block, replacing it and everything after it when it
+  // is too small. Those blocks are unused, everything in use is behind us.
+  ArenaBlock *next = block != NULL ? block->next : arena->first;
+  if (next != NULL && next->capacity < length) {
+    while (next != NULL) {
+      ArenaBlock *t = next->next;
+      free(next);
+      next = t;
+    }
+  }
+
+  if (next == NULL) {
+    int capacity = block != NULL ? block->capacity * 2 : ARENA_MIN_BLOCK;
+    if (capacity < length) {
+      capacity = length;
+    }
+    next = (ArenaBlock *)malloc(sizeof(ArenaBlock) + capacity * sizeof(Limb));
+    if (next == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    allocations++;
+    next->next = NULL;
+    next->capacity = capacity;
+    if (block != NULL) {
+      block->next = next;
+    } else {
+      arena->first = next;
+    }
+  }
+
+  next->used = length;
+  arena->current = next;
+  return next->limbs;
+}
+
+ArenaMark arena_mark(Arena *arena) {
+  return (ArenaMark){.block = arena->current,
+                     .used = arena->current ? arena->current->used : 0};
+}
+
+void arena_release(Arena *arena, ArenaMark mark) {
+  arena->current = mark.block;
+  if (mark.block != NULL) {
+    mark.block->used = mark.used;
+  }
+}
+
+void arena_free(Arena *arena) {
+  while (arena->first != NULL) {
+    ArenaBlock *next = arena->first->next;
+    free(arena->first);
+    arena->first = next;
+  }
+  arena->current = NULL;
+}
+
+void normalize(Number *number) {
+  while (number->length > 0 && number->limbs[number->length - 1] == 0) {
+    number->length--;
+  }
+  if (number->length == 0) {
+    number->negative = false;
+  }
+}
+
+Number copy_number(Number number) {
+  Number copy = number;
+  copy.capacity = number.length;
+  copy.limbs = allocate_limbs(number.length);
+  memcpy(copy.limbs, number.limbs, number.length * sizeof(Limb));
+  return copy;
+}
+
+// Compares two normalized magnitudes, returns -1, 0 or 1
+int limbs_cmp(const Limb *a, int an, const Limb *b, int bn) {
+  if (an != bn) {
+    return an < bn ? -1 : 1;
+  }
+  for (int i = an - 1; i >= 0; i--) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+// r = a * m + addend, returns the limb carried out of the top
+Limb limbs_mul_1_add(Limb *r, const Limb *a, int n, Limb m, Limb addend) {
+  Limb carry = addend;
+  for (int i = 0; i < n; i++) {
+    DoubleLimb t = (DoubleLimb)a[i] * m + carry;
+    r[i] = (Limb)t;
+    carry = (Limb)(t >> LIMB_BITS);
+  }
+  return carry;
+}
+
+// r += a * m, returns the limb carried out of the top
+Limb limbs_addmul_1(Limb *r, const Limb *a, int n, Limb m) {
+  Limb carry = 0;
+  for (int i = 0; i < n; i++) {
+    DoubleLimb t = (DoubleLimb)a[i] * m + r[i] + carry;
+    r[i] = (Limb)t;
+    carry = (Limb)(t >> LIMB_BITS);
+  }
+  return carry;
+}
+
+// r -= a * m, returns the limb borrowed from above the top
+Limb limbs_submul_1(Limb *r, const Limb *a, int n, Limb m) {
+  Limb borrow = 0;
+  for (int i = 0; i < n; i++) {
+    DoubleLimb t = (DoubleLimb)a[i] * m + borrow;
+    Limb low = (Limb)t;
+    borrow = (Limb)(t >> LIMB_BITS);
+    borrow += r[i] < low;
+    r[i] -= low;
+  }
+  return borrow;
+}
+
+// r = a << shift for 0 <= shift < LIMB_BITS, returns the bits shifted out
+Limb limbs_shl(Limb *r, const Limb *a, int n, int shift) {
+  if (shift == 0) {
+    memmove(r, a, n * sizeof(Limb));
+    return 0;
+  }
+  Limb out = 0;
+  for (int i = 0; i < n; i++) {
+    Limb limb = a[i];
+    r[i] = (limb << shift) | out;
+    out = limb >> (LIMB_BITS - shift);
+  }
+  return out;
+}
+
+// r = a >> shift for 0 <= shift < LIMB_BITS
+void limbs_shr(Limb *r, const Limb *a, int n, int shift) {
+  if (shift == 0) {
+    memmove(r, a, n * sizeof(Limb));
+    return;
+  }
+  for (int i = 0; i < n; i++) {
+    Limb high = (i + 1 < n) ? a[i + 1] << (LIMB_BITS - shift) : 0;
+    r[i] = (a[i] >> shift) | high;
+  }
+}
+
+// q = a / d, returns the remainder
+Limb limbs_div_1(Limb *q, const Limb *a, int n, Limb d) {
+  DoubleLimb remainder = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    DoubleLimb t = (remainder << LIMB_BITS) | a[i];
+    q[i] = (Limb)(t / d);
+    remainder = t % d;
+  }
+  return (Limb)remainder;
+}
+
+// Carry propagating kernels: r = a + b and r = a - b over n limbs, returning
+// the carry or borrow out of the top. r may be a or b.
+typedef Limb (*CarryKernel)(Limb *r, const Limb *a, const Limb *b, int n);
+
+Limb limbs_add_n_scalar(Limb *r, const Limb *a, const Limb *b, int n) {
+  Limb carry = 0;
+  for (int i = 0; i < n; i++) {
+    Limb sum = a[i] + carry;
+    carry = sum < carry;
+    r[i] = sum + b[i];
+    carry += r[i] < sum;
+  }
+  return carry;
+}
+
+Limb limbs_sub_n_scalar(Limb *r, const Limb *a, const Limb *b, int n) {
+  Limb borrow = 0;
+  for (int i = 0; i < n; i++) {
+    Limb limb = b[i];
+    Limb diff = a[i] - borrow;
+    borrow = a[i] < borrow;
+    r[i] = diff - limb;
+    borrow += diff < limb;
+  }
+  return borrow;
+}
+
+#if defined(__x86_64__)
+// A single adc/sbb chain, unrolled so the loop overhead stays off the
+// carry's critical path
+Limb limbs_add_n_adc(Limb *r, const Limb *a, const Limb *b, int n) {
+  unsigned long long *out = (unsigned long long *)r;
+  unsigned char carry = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    carry = _addcarry_u64(carry, a[i], b[i], &out[i]);
+    carry = _addcarry_u64(carry, a[i + 1], b[i + 1], &out[i + 1]);
+    carry = _addcarry_u64(carry, a[i + 2], b[i + 2], &out[i + 2]);
+    carry = _addcarry_u64(carry, a[i + 3], b[i + 3], &out[i + 3]);
+  }
+  for (; i < n; i++) {
+    carry = _addcarry_u64(carry, a[i], b[i], &out[i]);
+  }
+  return carry;
+}
+
+Limb limbs_sub_n_sbb(Limb *r, const Limb *a, const Limb *b, int n) {
+  unsigned long long *out = (unsigned long long *)r;
+  unsigned char borrow = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    borrow = _subborrow_u64(borrow, a[i], b[i], &out[i]);
+    borrow = _subborrow_u64(borrow, a[i + 1], b[i + 1], &out[i + 1]);
+    borrow = _subborrow_u64(borrow, a[i + 2], b[i + 2], &out[i + 2]);
+    borrow = _subborrow_u64(borrow, a[i + 3], b[i + 3], &out[i + 3]);
+  }
+  for (; i < n; i++) {
+    borrow = _subborrow_u64(borrow, a[i], b[i], &out[i]);
+  }
+  return borrow;
+}
+
+// Carry lookahead over blocks of 8 limbs. Each lane's sum either generates
+// a carry (it wrapped) or propagates one (it is all ones). With those as
+// bit masks G and P, the carries into the lanes are (P + 2G + carry_in) ^ P,
+// one scalar add per block, and bit 8 of the sum is the block's carry out.
+__attribute__((target("avx2"))) Limb
+limbs_add_n_avx2(Limb *r, const Limb *a, const Limb *b, int n) {
+  const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i one = _mm256_set1_epi64x(1);
+
+  unsigned carry = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 4));
+    __m256i s0 = _mm256_add_epi64(
+        x0, _mm256_loadu_si256((const __m256i *)(b + i)));
+    __m256i s1 = _mm256_add_epi64(
+        x1, _mm256_loadu_si256((const __m256i *)(b + i + 4)));
+
+    // Unsigned s < x via signed compares on biased values
+    __m256i g0 = _mm256_cmpgt_epi64(_mm256_xor_si256(x0, bias),
+                                    _mm256_xor_si256(s0, bias));
+    __m256i g1 = _mm256_cmpgt_epi64(_mm256_xor_si256(x1, bias),
+                                    _mm256_xor_si256(s1, bias));
+    __m256i p0 = _mm256_cmpeq_epi64(s0, ones);
+    __m256i p1 = _mm256_cmpeq_epi64(s1, ones);
+
+    unsigned g = _mm256_movemask_pd(_mm256_castsi256_pd(g0)) |
+                 _mm256_movemask_pd(_mm256_castsi256_pd(g1)) << 4;
+    unsigned p = _mm256_movemask_pd(_mm256_castsi256_pd(p0)) |
+                 _mm256_movemask_pd(_mm256_castsi256_pd(p1)) << 4;
+    unsigned sum = p + 2 * g + carry;
+    unsigned c = sum ^ p;
+    carry = sum >> 8;
+
+    __m256i c0 = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_set1_epi64x(c), lanes), one);
+    __m256i c1 = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_set1_epi64x(c >> 4), lanes), one);
+    _mm256_storeu_si256((__m256i *)(r + i), _mm256_add_epi64(s0, c0));
+    _mm256_storeu_si256((__m256i *)(r + i + 4), _mm256_add_epi64(s1, c1));
+  }
+
+  Limb c = carry;
+  for (; i < n; i++) {
+    Limb sum = a[i] + c;
+    c = sum < c;
+    r[i] = sum + b[i];
+    c += r[i] < sum;
+  }
+  return c;
+}
+
+// The same lookahead for borrows: a lane generates one when a < b and
+// propagates one when the difference is zero
+__attribute__((target("avx2"))) Limb
+limbs_sub_n_avx2(Limb *r, const Limb *a, const Limb *b, int n) {
+  const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i one = _mm256_set1_epi64x(1);
+
+  unsigned borrow = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 4));
+    __m256i y0 = _mm256_loadu_si256((const __m256i *)(b + i));
+    __m256i y1 = _mm256_loadu_si256((const __m256i *)(b + i + 4));
+    __m256i d0 = _mm256_sub_epi64(x0, y0);
+    __m256i d1 = _mm256_sub_epi64(x1, y1);
+
+    __m256i g0 = _mm256_cmpgt_epi64(_mm256_xor_si256(y0, bias),
+                                    _mm256_xor_si256(x0, bias));
+    __m256i g1 = _mm256_cmpgt_epi64(_mm256_xor_si256(y1, bias),
+                                    _mm256_xor_si256(x1, bias));
+    __m256i p0 = _mm256_cmpeq_epi64(d0, zero);
+    __m256i p1 = _mm256_cmpeq_epi64(d1, zero);
+
+    unsigned g = _mm256_movemask_pd(_mm256_castsi256_pd(g0)) |
+                 _mm256_movemask_pd(_mm256_castsi256_pd(g1)) << 4;
+    unsigned p = _mm256_movemask_pd(_mm256_castsi256_pd(p0)) |
+                 _mm256_movemask_pd(_mm256_castsi256_pd(p1)) << 4;
+    unsigned sum = p + 2 * g + borrow;
+    unsigned c = sum ^ p;
+    borrow = sum >> 8;
+
+    __m256i c0 = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_set1_epi64x(c), lanes), one);
+    __m256i c1 = _mm256_and_si256(
+        _mm256_srlv_epi64(_mm256_set1_epi64x(c >> 4), lanes), one);
+    _mm256_storeu_si256((__m256i *)(r + i), _mm256_sub_epi64(d0, c0));
+    _mm256_storeu_si256((__m256i *)(r + i + 4), _mm256_sub_epi64(d1, c1));
+  }
+
+  Limb c = borrow;
+  for (; i < n; i++) {
+    Limb limb = b[i];
+    Limb diff = a[i] - c;
+    c = a[i] < c;
+    r[i] = diff - limb;
+    c += diff < limb;
+  }
+  return c;
+}
+#endif
+
+typedef struct {
+  const char *name;
+  CarryKernel add;
+  CarryKernel sub;
+} CarryKernels;
+
+CarryKernels carry_kernels[] = {
+    {"scalar", limbs_add_n_scalar, limbs_sub_n_scalar},
+#if defined(__x86_64__)
+    {"adc", limbs_add_n_adc, limbs_sub_n_sbb},
+    {"avx2", limbs_add_n_avx2, limbs_sub_n_avx2},
+#endif
+};
+
+#define CARRY_KERNEL_COUNT                                                     \
+  (int)(sizeof(carry_kernels) / sizeof(carry_kernels[0]))
+
+bool carry_kernel_supported(const CarryKernels *kernels) {
+#if defined(__x86_64__)
+  if (strcmp(kernels->name, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return true;
+}
+
+Limb limbs_add_n_select(Limb *r, const Limb *a, const Limb *b, int n);
+Limb limbs_sub_n_select(Limb *r, const Limb *a, const Limb *b, int n);
+
+// The kernels in use, picked on first call
+CarryKernel limbs_add_n = limbs_add_n_select;
+CarryKernel limbs_sub_n = limbs_sub_n_select;
+
+// Switches to the named kernels, returns false if the CPU can't run them
+bool use_carry_kernels(const char *name) {
+  for (int i = 0; i < CARRY_KERNEL_COUNT; i++) {
+    if (strcmp(carry_kernels[i].name, name) == 0 &&
+        carry_kernel_supported(&carry_kernels[i])) {
+      limbs_add_n = carry_kernels[i].add;
+      limbs_sub_n = carry_kernels[i].sub;
+      return true;
+    }
+  }
+  return false;
+}
+
+// BIGNUM_CARRY_KERNEL can name a kernel. Otherwise x86-64 uses the adc chain,
+// which measured ahead of the AVX2 lookahead (about 0.6 against 0.8 ns per
+// limb in cache), and everything else the portable loop.
+void select_carry_kernels() {
+  // A choice made with use_carry_kernels() before the first call stands
+  if (limbs_add_n != limbs_add_n_select) {
+    return;
+  }
+  const char *name = getenv("BIGNUM_CARRY_KERNEL");
+  if (name != NULL && use_carry_kernels(name)) {
+    return;
+  }
+  if (!use_carry_kernels("adc")) {
+    use_carry_kernels("scalar");
+  }
+}
+
+pthread_once_t carry_kernels_once = PTHREAD_ONCE_INIT;
+
+// Picks the kernels once. The first call writes limbs_add_n and
+// limbs_sub_n, so threads that add or subtract must start after it, as
+// sum_many() makes sure of for its workers.
+void init_carry_kernels() {
+  pthread_once(&carry_kernels_once, select_carry_kernels);
+}
+
+Limb limbs_add_n_select(Limb *r, const Limb *a, const Limb *b, int n) {
+  init_carry_kernels();
+  return limbs_add_n(r, a, b, n);
+}
+
+Limb limbs_sub_n_select(Limb *r, const Limb *a, const Limb *b, int n) {
+  init_carry_kernels();
+  return limbs_sub_n(r, a, b, n);
+}
+
+// r = a + b where an >= bn, returns the carry out of limb an - 1
+Limb limbs_add(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+  Limb carry = limbs_add_n(r, a, b, bn);
+
+  // Past b only the carry moves, and once it dies the rest is a copy
+  int i = bn;
+  for (; carry > 0 && i < an; i++) {
+    r[i] = a[i] + 1;
+    carry = r[i] == 0;
+  }
+  if (r != a) {
+    memmove(r + i, a + i, (an - i) * sizeof(Limb));
+  }
+  return carry;
+}
+
+// r = a - b where a >= b and an >= bn, returns the borrow out of limb an - 1
+Limb limbs_sub(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+  Limb borrow = limbs_sub_n(r, a, b, bn);
+
+  int i = bn;
+  for (; borrow > 0 && i < an; i++) {
+    Limb limb = a[i];
+    r[i] = limb - 1;
+    borrow = limb == 0;
+  }
+  if (r != a) {
+    memmove(r + i, a + i, (an - i) * sizeof(Limb));
+  }
+  return borrow;
+}
+
+// r = -a modulo B^n, i.e. the two's complement of a
+void limbs_neg(Limb *r, const Limb *a, int n) {
+  Limb carry = 1;
+  for (int i = 0; i < n; i++) {
+    r[i] = ~a[i] + carry;
+    carry = carry && r[i] == 0;
+  }
+}
+
+// Divides the two's complement value a by 2 in place, rounding down
+void limbs_sar_1(Limb *a, int n) {
+  Limb sign = a[n - 1] & ((Limb)1 << (LIMB_BITS - 1));
+  limbs_shr(a, a, n, 1);
+  a[n - 1] |= sign;
+}
+
+// Divides a by 3 in place modulo B^n. Only valid when a is an exact multiple
+// of 3, in which case it also works on two's complement values.
+void limbs_divexact_3(Limb *a, int n) {
+  const Limb inverse = 0xAAAAAAAAAAAAAAABULL; // 3 * inverse == 1 mod 2^64
+  Limb borrow = 0;
+  for (int i = 0; i < n; i++) {
+    Limb limb = a[i];
+    Limb t = limb - borrow;
+    borrow = limb < borrow;
+    Limb q = t * inverse;
+    a[i] = q;
+    // Add the high limb of 3 * q
+    borrow += (q >= 0x5555555555555556ULL) + (q >= 0xAAAAAAAAAAAAAAABULL);
+  }
+}
+
+// Schoolbook product, r must have an + bn limbs and not overlap a or b
+void limbs_mul_basecase(Limb *r, const Limb *a, int an, const Limb *b,
+                        int bn) {
+  memset(r, 0, (an + bn) * sizeof(Limb));
+  for (int i = 0; i < bn; i++) {
+    r[i + an] = limbs_addmul_1(r + i, a, an, b[i]);
+  }
+}
+
+// Operand sizes, in limbs, at which balanced products move from schoolbook
+// to Karatsuba, from Karatsuba to Toom-3 and from Toom-3 to the NTT. They
+// are variables so they can be tuned for the host, the BENCHMARK build
+// measures them.
+int karatsuba_threshold = 32;
+int toom3_threshold = 160;
+int ntt_threshold = 32768;
+
+void limbs_mul_n(Limb *r, const Limb *a, const Limb *b, int n);
+
+// Karatsuba product of two n limb operands into the 2n limbs of r
+void limbs_mul_karatsuba(Limb *r, const Limb *a, const Limb *b, int n) {
+  int l = n / 2;
+  int h = n - l;
+
+  // (a1 B^l + a0)(b1 B^l + b0) = z2 B^2l + z1 B^l + z0 where
+  // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *sa = arena_alloc(&scratch, 4 * h + 4);
+  Limb *sb = sa + h + 1;
+  Limb *z1 = sb + h + 1;
+
+  sa[h] = limbs_add(sa, a + l, h, a, l);
+  sb[h] = limbs_add(sb, b + l, h, b, l);
+
+  limbs_mul_n(r, a, b, l);
+  limbs_mul_n(r + 2 * l, a + l, b + l, h);
+  limbs_mul_n(z1, sa, sb, h + 1);
+
+  limbs_sub(z1, z1, 2 * h + 2, r, 2 * l);
+  limbs_sub(z1, z1, 2 * h + 2, r + 2 * l, 2 * h);
+
+  // z1 < 2 B^2h, so its top limb is zero and the carry never leaves r
+  limbs_add(r + l, r + l, 2 * n - l, z1, 2 * h + 1);
+
+  arena_release(&scratch, mark);
+}
+
+// Evaluates a0 + a1 x + a2 x^2 at x = 1, -1 and -2 for Toom-3. Each result
+// is written as a sign and a k + 1 limb magnitude.
+void toom3_evaluate(Limb *p1, Limb *pm1, Limb *pm2, bool *signs, const Limb *a,
+                    int k, int n2) {
+  // Intermediate values fit in k + 2 limbs of two's complement
+  int e = k + 2;
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *t = arena_alloc(&scratch, 4 * e);
+  Limb *v1 = t + e, *vm1 = v1 + e, *vm2 = vm1 + e;
+
+  memset(t, 0, e * sizeof(Limb));
+  memcpy(t, a, k * sizeof(Limb));
+  limbs_add(t, t, e, a + 2 * k, n2); // a0 + a2
+
+  limbs_add(v1, t, e, a + k, k);  // a0 + a1 + a2
+  limbs_sub(vm1, t, e, a + k, k); // a0 - a1 + a2
+  limbs_add(vm2, vm1, e, a + 2 * k, n2);
+  limbs_shl(vm2, vm2, e, 1);
+  limbs_sub(vm2, vm2, e, a, k); // a0 - 2 a1 + 4 a2
+
+  Limb *values[] = {v1, vm1, vm2};
+  Limb *outputs[] = {p1, pm1, pm2};
+  for (int i = 0; i < 3; i++) {
+    signs[i] = values[i][e - 1] >> (LIMB_BITS - 1);
+    if (signs[i]) {
+      limbs_neg(values[i], values[i], e);
+    }
+    memcpy(outputs[i], values[i], (k + 1) * sizeof(Limb));
+  }
+
+  arena_release(&scratch, mark);
+}
+
+// Toom-3 product of two n limb operands into the 2n limbs of r, using
+// Bodrato's evaluation points 0, 1, -1, -2 and infinity
+void limbs_mul_toom3(Limb *r, const Limb *a, const Limb *b, int n) {
+  int k = (n + 2) / 3;
+  int n2 = n - 2 * k;
+
+  // Products are at most 49 B^2k in magnitude, w limbs holds them signed
+  int w = 2 * k + 3;
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *a1 = arena_alloc(&scratch, 6 * (k + 1) + 3 * w);
+  Limb *am1 = a1 + k + 1, *am2 = am1 + k + 1;
+  Limb *b1 = am2 + k + 1, *bm1 = b1 + k + 1, *bm2 = bm1 + k + 1;
+  Limb *v1 = bm2 + k + 1, *vm1 = v1 + w, *vm2 = vm1 + w;
+
+  bool sa[3], sb[3];
+  toom3_evaluate(a1, am1, am2, sa, a, k, n2);
+  toom3_evaluate(b1, bm1, bm2, sb, b, k, n2);
+
+  // v0 and vinf go straight to their final place in r
+  Limb *v0 = r;
+  Limb *vinf = r + 4 * k;
+  limbs_mul_n(v0, a, b, k);
+  limbs_mul_n(vinf, a + 2 * k, b + 2 * k, n2);
+
+  Limb *products[] = {v1, vm1, vm2};
+  Limb *lefts[] = {a1, am1, am2};
+  Limb *rights[] = {b1, bm1, bm2};
+  for (int i = 0; i < 3; i++) {
+    limbs_mul_n(products[i], lefts[i], rights[i], k + 1);
+    products[i][w - 1] = 0;
+    if (sa[i] != sb[i]) {
+      limbs_neg(products[i], products[i], w);
     }
-    result.digits = (char*)realloc(result.digits, result.length + 1);
   }
 
+  // Interpolate in two's complement, ending with r1 in v1, r2 in vm1 and
+  // r3 in vm2
+  limbs_sub(vm2, vm2, w, v1, w);
+  limbs_divexact_3(vm2, w); // (vm2 - v1) / 3
+  limbs_sub(v1, v1, w, vm1, w);
+  limbs_sar_1(v1, w); // r1 = (v1 - vm1) / 2
+  limbs_sub(vm1, vm1, w, v0, 2 * k); // r2 = vm1 - v0
+  limbs_sub(vm2, vm1, w, vm2, w);
+  limbs_sar_1(vm2, w);
+  limbs_add(vm2, vm2, w, vinf, 2 * n2);
+  limbs_add(vm2, vm2, w, vinf, 2 * n2); // r3 = (r2 - r3) / 2 + 2 vinf
+  limbs_add(vm1, vm1, w, v1, w);
+  limbs_sub(vm1, vm1, w, vinf, 2 * n2); // r2 = r2 + r1 - vinf
+  limbs_sub(v1, v1, w, vm2, w);         // r1 = r1 - r3
+
+  // Recompose, r1..r3 are the true non-negative coefficients now
+  memset(r + 2 * k, 0, 2 * k * sizeof(Limb));
+  Limb *coefficients[] = {v1, vm1, vm2};
+  for (int i = 1; i <= 3; i++) {
+    int offset = i * k;
+    int length = (2 * n - offset < w) ? 2 * n - offset : w;
+    limbs_add(r + offset, r + offset, 2 * n - offset, coefficients[i - 1],
+              length);
+  }
+
+  arena_release(&scratch, mark);
+}
+
+// Number theoretic transform over p = 2^64 - 2^32 + 1. The multiplicative
+// group mod p has 2^32 | p - 1, so power of two transforms up to 2^32 points
+// exist, and products reduce with shifts and adds instead of a division.
+#define NTT_PRIME 0xFFFFFFFF00000001ULL
+#define NTT_GENERATOR 7
+
+// Operands are cut into 16 bit pieces, so a convolution term is below
+// 2^32 * pieces, which stays under p for any length the transform supports
+#define NTT_PIECE_BITS 16
+#define NTT_PIECES_PER_LIMB (LIMB_BITS / NTT_PIECE_BITS)
+
+static inline Limb ntt_reduce(DoubleLimb x) {
+  Limb low = (Limb)x;
+  Limb high = (Limb)(x >> LIMB_BITS);
+  Limb high_high = high >> 32;
+  Limb high_low = high & 0xFFFFFFFFULL;
+
+  // x = low + high_low 2^64 + high_high 2^96, where 2^64 = 2^32 - 1 and
+  // 2^96 = -1 modulo p. The corrections are masks rather than branches
+  // because their outcome is effectively random.
+  Limb t = low - high_high;
+  t -= -(Limb)(low < high_high) & 0xFFFFFFFFULL;
+  Limb u = high_low * 0xFFFFFFFFULL;
+  Limb result = t + u;
+  result += -(Limb)(result < u) & 0xFFFFFFFFULL;
+  return result - (-(Limb)(result >= NTT_PRIME) & NTT_PRIME);
+}
+
+static inline Limb ntt_mul(Limb a, Limb b) {
+  return ntt_reduce((DoubleLimb)a * b);
+}
+
+static inline Limb ntt_add(Limb a, Limb b) {
+  Limb sum = a + b;
+  // On overflow, subtracting p modulo 2^64 is the same as adding 2^32 - 1
+  return sum - (-(Limb)((sum < a) | (sum >= NTT_PRIME)) & NTT_PRIME);
+}
+
+static inline Limb ntt_sub(Limb a, Limb b) {
+  return a - b + (-(Limb)(a < b) & NTT_PRIME);
+}
+
+Limb ntt_pow(Limb base, Limb exponent) {
+  Limb result = 1;
+  for (; exponent > 0; exponent >>= 1) {
+    if (exponent & 1) {
+      result = ntt_mul(result, base);
+    }
+    base = ntt_mul(base, base);
+  }
   return result;
 }
 
-Number generate_number(int n, int d) {
-  Number number;
-  number.length = n;
-  number.digits = allocate_string(n + 1);
+// Fills roots[h + j] with w^j for each power of two h < n, where w is a
+// primitive 2h-th root of unity, so every butterfly stage reads its twiddle
+// factors contiguously. The inverse table uses the inverse roots.
+void ntt_roots(Limb *roots, int n, bool inverse) {
+  for (int h = 1; h < n; h <<= 1) {
+    Limb w = ntt_pow(NTT_GENERATOR, (NTT_PRIME - 1) / (2 * h));
+    if (inverse) {
+      w = ntt_pow(w, NTT_PRIME - 2);
+    }
+    roots[h] = 1;
+    for (int j = 1; j < h; j++) {
+      roots[h + j] = ntt_mul(roots[h + j - 1], w);
+    }
+  }
+}
+
+// Decimation in frequency transform of length n, a power of two. Takes
+// natural order and leaves the result in bit-reversed order, which is all a
+// convolution needs.
+void ntt_forward(Limb *x, int n, const Limb *roots) {
+  for (int h = n / 2; h >= 1; h >>= 1) {
+    for (int i = 0; i < n; i += 2 * h) {
+      for (int j = 0; j < h; j++) {
+        Limb u = x[i + j];
+        Limb v = x[i + j + h];
+        x[i + j] = ntt_add(u, v);
+        x[i + j + h] = ntt_mul(ntt_sub(u, v), roots[h + j]);
+      }
+    }
+  }
+}
+
+// Decimation in time transform that undoes ntt_forward() when given the
+// inverse roots, taking bit-reversed order back to natural order. The result
+// is n times too large.
+void ntt_backward(Limb *x, int n, const Limb *roots) {
+  for (int h = 1; h < n; h <<= 1) {
+    for (int i = 0; i < n; i += 2 * h) {
+      for (int j = 0; j < h; j++) {
+        Limb u = x[i + j];
+        Limb v = ntt_mul(x[i + j + h], roots[h + j]);
+        x[i + j] = ntt_add(u, v);
+        x[i + j + h] = ntt_sub(u, v);
+      }
+    }
+  }
+}
+
+void ntt_split(Limb *x, int n, const Limb *a, int an) {
+  for (int i = 0; i < an * NTT_PIECES_PER_LIMB; i++) {
+    int shift = (i % NTT_PIECES_PER_LIMB) * NTT_PIECE_BITS;
+    x[i] = (a[i / NTT_PIECES_PER_LIMB] >> shift) & 0xFFFF;
+  }
+  memset(x + an * NTT_PIECES_PER_LIMB, 0,
+         (n - an * NTT_PIECES_PER_LIMB) * sizeof(Limb));
+}
+
+// r = a * b by convolution in the NTT domain. The result is exact: each
+// coefficient of the convolution is recovered exactly and the carries are
+// propagated through the 16 bit pieces afterwards. r must have an + bn limbs
+// and not overlap a or b.
+void limbs_mul_ntt(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+  int pieces = (an + bn) * NTT_PIECES_PER_LIMB;
+  int n = 1;
+  while (n < pieces - 1) {
+    n <<= 1;
+  }
+
+  bool square = (a == b && an == bn);
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *fa = arena_alloc(&scratch, n);
+  Limb *fb = square ? fa : arena_alloc(&scratch, n);
+  Limb *roots = arena_alloc(&scratch, n);
+  Limb *inverse_roots = arena_alloc(&scratch, n);
+  ntt_roots(roots, n, false);
+  ntt_roots(inverse_roots, n, true);
+
+  ntt_split(fa, n, a, an);
+  ntt_forward(fa, n, roots);
+  if (!square) {
+    ntt_split(fb, n, b, bn);
+    ntt_forward(fb, n, roots);
+  }
+
+  // Pointwise products, folding in the 1 / n of the inverse transform
+  Limb scale = ntt_pow(n, NTT_PRIME - 2);
   for (int i = 0; i < n; i++) {
-    number.digits[i] = '0'+ d;
+    fa[i] = ntt_mul(ntt_mul(fa[i], fb[i]), scale);
   }
-  number.digits[n] = '\0';
-  return number;
+  ntt_backward(fa, n, inverse_roots);
+
+  memset(r, 0, (an + bn) * sizeof(Limb));
+  DoubleLimb carry = 0;
+  for (int i = 0; i < pieces; i++) {
+    carry += (i < n) ? fa[i] : 0;
+    int shift = (i % NTT_PIECES_PER_LIMB) * NTT_PIECE_BITS;
+    r[i / NTT_PIECES_PER_LIMB] |= (Limb)(carry & 0xFFFF) << shift;
+    carry >>= NTT_PIECE_BITS;
+  }
+
+  arena_release(&scratch, mark);
 }
 
-int main() {
-  {
-    Number a = create_number("12345678901234567890");
-    Number b = create_number("98765432109876543210");
+// Product of two n limb operands into the 2n limbs of r, picking the
+// algorithm by size
+void limbs_mul_n(Limb *r, const Limb *a, const Limb *b, int n) {
+  // Karatsuba needs at least 2 limbs to split and Toom-3 at least 5
+  if (n < karatsuba_threshold || n < 2) {
+    limbs_mul_basecase(r, a, n, b, n);
+  } else if (n < toom3_threshold || n < 5) {
+    limbs_mul_karatsuba(r, a, b, n);
+  } else if (n < ntt_threshold) {
+    limbs_mul_toom3(r, a, b, n);
+  } else {
+    limbs_mul_ntt(r, a, n, b, n);
+  }
+}
 
-    Number result = add(a, b);
+// r = a * b for an >= bn, r must have an + bn limbs and not overlap a or b
+void limbs_mul(Limb *r, const Limb *a, int an, const Limb *b, int bn) {
+  if (an == bn) {
+    limbs_mul_n(r, a, b, an);
+    return;
+  }
+
+  if (bn < karatsuba_threshold) {
+    limbs_mul_basecase(r, a, an, b, bn);
+    return;
+  }
 
-    printf("Result: %s\n", result.digits);
+  // The transform handles unbalanced operands directly
+  if (bn >= ntt_threshold) {
+    limbs_mul_ntt(r, a, an, b, bn);
+    return;
+  }
 
-    free_number(a);
-    free_number(b);
-    free_number(result);
+  // Cut the longer operand into bn limb pieces so every piece is a balanced
+  // product, and accumulate the partial products
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *partial = arena_alloc(&scratch, 2 * bn);
+  memset(r, 0, (an + bn) * sizeof(Limb));
+  for (int i = 0; i < an; i += bn) {
+    int length = (an - i < bn) ? an - i : bn;
+    if (length == bn) {
+      limbs_mul_n(partial, a + i, b, bn);
+    } else {
+      limbs_mul(partial, b, bn, a + i, length);
+    }
+    limbs_add(r + i, r + i, an + bn - i, partial, length + bn);
   }
+  arena_release(&scratch, mark);
+}
 
-  {
-    Number a = generate_number(999, 9);
-    Number b = create_number("1");
+// Knuth's algorithm D. For an >= bn and b[bn - 1] != 0, writes the
+// an - bn + 1 limbs of a / b to q and the bn limbs of a % b to r.
+void limbs_divmod(Limb *q, Limb *r, const Limb *a, int an, const Limb *b,
+                  int bn) {
+  if (bn == 1) {
+    r[0] = limbs_div_1(q, a, an, b[0]);
+    return;
+  }
 
-    Number result = add(a, b);
+  // Shift both operands so the divisor's top bit is set, which keeps every
+  // quotient estimate within two of the true digit
+  int shift = __builtin_clzll(b[bn - 1]);
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *v = arena_alloc(&scratch, bn);
+  Limb *u = arena_alloc(&scratch, an + 1);
+  limbs_shl(v, b, bn, shift);
+  u[an] = limbs_shl(u, a, an, shift);
 
-    printf("Result: %s\n", result.digits);
+  Limb top = v[bn - 1];
+  Limb next = v[bn - 2];
 
-    free_number(a);
-    free_number(b);
-    free_number(result);
+  for (int j = an - bn; j >= 0; j--) {
+    DoubleLimb numerator = ((DoubleLimb)u[j + bn] << LIMB_BITS) | u[j + bn - 1];
+    DoubleLimb qhat = numerator / top;
+    DoubleLimb rhat = numerator % top;
+
+    while ((qhat >> LIMB_BITS) != 0 ||
+           qhat * next > ((rhat << LIMB_BITS) | u[j + bn - 2])) {
+      qhat--;
+      rhat += top;
+      if ((rhat >> LIMB_BITS) != 0) {
+        break;
+      }
+    }
+
+    Limb borrow = limbs_submul_1(u + j, v, bn, (Limb)qhat);
+    Limb high = u[j + bn];
+    u[j + bn] = high - borrow;
+
+    // The estimate was one too large, add the divisor back
+    if (high < borrow) {
+      qhat--;
+      u[j + bn] += limbs_add(u + j, u + j, bn, v, bn);
+    }
+
+    q[j] = (Limb)qhat;
+  }
+
+  limbs_shr(r, u, bn, shift);
+  arena_release(&scratch, mark);
+}
+
+Number number_from_limb(Limb value) {
+  Number number = {.length = value > 0, .capacity = 1};
+  number.limbs = allocate_limbs(1);
+  number.limbs[0] = value;
+  return number;
+}
+
+// Quadratic parse of a run of decimal digits into a nonnegative number
+Number parse_basecase(const char *str, int digits) {
+  // log2(10) < 3.33 bits per digit, plus one limb of slack
+  Number number;
+  number.length = 0;
+  number.capacity = (int)((long)digits * 333 / 100 / LIMB_BITS) + 2;
+  number.negative = false;
+  number.limbs = allocate_limbs(number.capacity);
+
+  // Consume the digits in chunks of DECIMAL_DIGITS, most significant first
+  int chunk = digits % DECIMAL_DIGITS;
+  if (chunk == 0) {
+    chunk = DECIMAL_DIGITS;
+  }
+
+  for (int i = 0; i < digits; i += chunk, chunk = DECIMAL_DIGITS) {
+    Limb value = 0;
+    Limb scale = 1;
+    for (int j = 0; j < chunk; j++) {
+      value = value * 10 + (str[i + j] - '0');
+      scale *= 10;
+    }
+
+    Limb carry = limbs_mul_1_add(number.limbs, number.limbs, number.length,
+                                 scale, value);
+    if (carry > 0) {
+      number.limbs[number.length++] = carry;
+    }
+  }
+
+  normalize(&number);
+  return number;
+}
+
+// Quadratic formatting of a nonnegative number. The digits are written right
+// to left so that the last one lands just before end, which needs up to 20
+// characters per limb, and the first one is returned. Zero writes nothing.
+char *format_basecase(const Limb *limbs, int length, char *end) {
+  ArenaMark mark = arena_mark(&scratch);
+  Limb *quotient = arena_alloc(&scratch, length);
+  memcpy(quotient, limbs, length * sizeof(Limb));
+
+  // Peel off DECIMAL_DIGITS at a time
+  char *p = end;
+  while (length > 0) {
+    Limb remainder = limbs_div_1(quotient, quotient, length, DECIMAL_BASE);
+    while (length > 0 && quotient[length - 1] == 0) {
+      length--;
+    }
+
+    for (int j = 0; j < DECIMAL_DIGITS && (length > 0 || remainder > 0);
+         j++) {
+      *--p = '0' + remainder % 10;
+      remainder /= 10;
+    }
+  }
+
+  arena_release(&scratch, mark);
+  return p;
+}
+
+void free_number(Number number) {
+  free(number.limbs);
+  number.limbs = NULL;
+  number.length = 0;
+  number.capacity = 0;
+}
+
+int compare(Number a, Number b) {
+  if (a.negative != b.negative) {
+    return a.negative ? -1 : 1;
+  }
+  int magnitude = limbs_cmp(a.limbs, a.length, b.limbs, b.length);
+  return a.negative ? -magnitude : magnitude;
+}
+
+// Reserves capacity in dst like reserve(), repointing the operands a and b
+// if they shared dst's buffer and it moved
+void reserve_operands(Number *dst, int capacity, Number *a, Number *b) {
+  Limb *old = dst->limbs;
+  reserve(dst, capacity);
+  if (a->limbs == old) {
+    a->limbs = dst->limbs;
+  }
+  if (b->limbs == old) {
+    b->limbs = dst->limbs;
+  }
+}
+
+// dst = a + b, reusing dst's buffer. dst may be a or b.
+void add_into(Number *dst, Number a, Number b) {
+  int magnitude = limbs_cmp(a.limbs, a.length, b.limbs, b.length);
+  if (magnitude < 0) {
+    Number t = a;
+    a = b;
+    b = t;
+  }
+
+  // |a| >= |b| from here on, so the result takes the sign of a. Both limb
+  // kernels are safe to run in place.
+  reserve_operands(dst, a.length + 1, &a, &b);
+  dst->length = a.length;
+  dst->negative = a.negative;
+
+  if (a.negative == b.negative) {
+    Limb carry = limbs_add(dst->limbs, a.limbs, a.length, b.limbs, b.length);
+    if (carry > 0) {
+      dst->limbs[dst->length++] = carry;
+    }
+  } else {
+    limbs_sub(dst->limbs, a.limbs, a.length, b.limbs, b.length);
+  }
+
+  normalize(dst);
+}
+
+// dst = a - b, reusing dst's buffer. dst may be a or b.
+void subtract_into(Number *dst, Number a, Number b) {
+  // b is a copy, so flipping its sign shares the caller's limbs safely
+  b.negative = !b.negative && b.length > 0;
+  add_into(dst, a, b);
+}
+
+// dst = a * b, reusing dst's buffer. dst may be a or b.
+void multiply_into(Number *dst, Number a, Number b) {
+  if (a.length == 0 || b.length == 0) {
+    dst->length = 0;
+    dst->negative = false;
+    return;
+  }
+
+  if (a.length < b.length) {
+    Number t = a;
+    a = b;
+    b = t;
+  }
+
+  int length = a.length + b.length;
+  bool negative = a.negative != b.negative;
+
+  if (dst->limbs == a.limbs || dst->limbs == b.limbs) {
+    // The product can't overwrite its own operands, so build it in scratch
+    ArenaMark mark = arena_mark(&scratch);
+    Limb *product = arena_alloc(&scratch, length);
+    limbs_mul(product, a.limbs, a.length, b.limbs, b.length);
+    reserve(dst, length);
+    memcpy(dst->limbs, product, length * sizeof(Limb));
+    arena_release(&scratch, mark);
+  } else {
+    reserve(dst, length);
+    limbs_mul(dst->limbs, a.limbs, a.length, b.limbs, b.length);
+  }
+
+  dst->length = length;
+  dst->negative = negative;
+  normalize(dst);
+}
+
+// Truncating division, so the remainder takes the sign of the dividend as
+// with C's / and %. Reuses the buffers of quotient and remainder, either of
+// which may be NULL or alias a or b.
+void divide_into(Number *quotient, Number *remainder, Number a, Number b) {
+  if (b.length == 0) {
+    fprintf(stderr, "Division by zero\n");
+    exit(EXIT_FAILURE);
+  }
+
+  bool quotient_negative = a.negative != b.negative;
+  bool remainder_negative = a.negative;
+
+  if (limbs_cmp(a.limbs, a.length, b.limbs, b.length) < 0) {
+    if (remainder != NULL) {
+      reserve_operands(remainder, a.length, &a, &b);
+      memmove(remainder->limbs, a.limbs, a.length * sizeof(Limb));
+      remainder->length = a.length;
+      remainder->negative = remainder_negative;
+    }
+    if (quotient != NULL) {
+      quotient->length = 0;
+      quotient->negative = false;
+    }
+    return;
+  }
+
+  // Both results land in scratch first, so the outputs can alias the inputs
+  ArenaMark mark = arena_mark(&scratch);
+  int quotient_length = a.length - b.length + 1;
+  Limb *q = arena_alloc(&scratch, quotient_length);
+  Limb *r = arena_alloc(&scratch, b.length);
+  limbs_divmod(q, r, a.limbs, a.length, b.limbs, b.length);
+
+  if (quotient != NULL) {
+    reserve(quotient, quotient_length);
+    memcpy(quotient->limbs, q, quotient_length * sizeof(Limb));
+    quotient->length = quotient_length;
+    quotient->negative = quotient_negative;
+    normalize(quotient);
+  }
+
+  if (remainder != NULL) {
+    reserve(remainder, b.length);
+    memcpy(remainder->limbs, r, b.length * sizeof(Limb));
+    remainder->length = b.length;
+    remainder->negative = remainder_negative;
+    normalize(remainder);
+  }
+
+  arena_release(&scratch, mark);
+}
+
+void add_assign(Number *dst, Number a) { add_into(dst, *dst, a); }
+
+void subtract_assign(Number *dst, Number a) { subtract_into(dst, *dst, a); }
+
+void multiply_assign(Number *dst, Number a) { multiply_into(dst, *dst, a); }
+
+Number add(Number a, Number b) {
+  Number result = {0};
+  add_into(&result, a, b);
+  return result;
+}
+
+Number subtract(Number a, Number b) {
+  Number result = {0};
+  subtract_into(&result, a, b);
+  return result;
+}
+
+Number multiply(Number a, Number b) {
+  Number result = {0};
+  multiply_into(&result, a, b);
+  return result;
+}
+
+// Like divide_into(), but both results are new numbers
+void divide(Number a, Number b, Number *quotient, Number *remainder) {
+  if (quotient != NULL) {
+    *quotient = (Number){0};
+  }
+  if (remainder != NULL) {
+    *remainder = (Number){0};
+  }
+  divide_into(quotient, remainder, a, b);
+}
+
+// sum += limbs over n limbs without propagating carries, counting the carry
+// out of limb j in carries[j]
+void limbs_accumulate(Limb *sum, Limb *carries, const Limb *limbs, int n) {
+  for (int j = 0; j < n; j++) {
+    Limb s = sum[j] + limbs[j];
+    carries[j] += s < limbs[j];
+    sum[j] = s;
+  }
+}
+
+#if defined(__x86_64__)
+// The lanes never interact, so four go at a time
+__attribute__((target("avx2"))) void
+limbs_accumulate_avx2(Limb *sum, Limb *carries, const Limb *limbs, int n) {
+  const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(limbs + j));
+    __m256i s =
+        _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum + j)), x);
+
+    // All ones where s < x unsigned, so subtracting counts the carry
+    __m256i c = _mm256_cmpgt_epi64(_mm256_xor_si256(x, bias),
+                                   _mm256_xor_si256(s, bias));
+    _mm256_storeu_si256((__m256i *)(sum + j), s);
+    _mm256_storeu_si256(
+        (__m256i *)(carries + j),
+        _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(carries + j)),
+                         c));
+  }
+  limbs_accumulate(sum + j, carries + j, limbs + j, n - j);
+}
+#endif
+
+// Sums the magnitudes of the numbers with the given sign. Carries are
+// counted per limb instead of propagated, which keeps the inner loop free of
+// dependencies between limbs, and are added in once at the end.
+Number sum_magnitudes(const Number *numbers, int count, bool negative) {
+  void (*accumulate)(Limb *, Limb *, const Limb *, int) = limbs_accumulate;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    accumulate = limbs_accumulate_avx2;
+  }
+#endif
+
+  int length = 0;
+  for (int i = 0; i < count; i++) {
+    if (numbers[i].negative == negative && numbers[i].length > length) {
+      length = numbers[i].length;
+    }
+  }
+
+  // The sum of count numbers below B^length is below B^(length + 1) as long
+  // as count < B, so one extra limb holds it
+  Number sum = {0};
+  reserve(&sum, length + 1);
+  Limb *carries = allocate_limbs(length);
+  memset(sum.limbs, 0, (length + 1) * sizeof(Limb));
+  memset(carries, 0, length * sizeof(Limb));
+
+  for (int i = 0; i < count; i++) {
+    if (numbers[i].negative == negative) {
+      accumulate(sum.limbs, carries, numbers[i].limbs, numbers[i].length);
+    }
+  }
+
+  limbs_add(sum.limbs + 1, sum.limbs + 1, length, carries, length);
+  sum.length = length + 1;
+  normalize(&sum);
+  free(carries);
+  return sum;
+}
+
+// One contiguous run of the operands of sum_many()
+typedef struct SumTask {
+  const Number *numbers;
+  int count;
+  int index;
+  int threads;
+  Number sum;
+  struct SumTask *tasks;
+  pthread_barrier_t *barrier;
+} SumTask;
+
+void *sum_worker(void *arg) {
+  SumTask *task = (SumTask *)arg;
+
+  Number positive = sum_magnitudes(task->numbers, task->count, false);
+  Number negative = sum_magnitudes(task->numbers, task->count, true);
+  subtract_into(&task->sum, positive, negative);
+  free_number(positive);
+  free_number(negative);
+
+  // Pairwise tree over the partial sums, each level after a barrier so the
+  // partner's sum from the level below is complete
+  for (int stride = 1; stride < task->threads; stride *= 2) {
+    pthread_barrier_wait(task->barrier);
+    int partner = task->index + stride;
+    if (task->index % (2 * stride) == 0 && partner < task->threads) {
+      add_assign(&task->sum, task->tasks[partner].sum);
+    }
+  }
+  return NULL;
+}
+
+// The sum of count numbers. The operands are split into contiguous runs,
+// one per thread, and the partial sums combined pairwise. threads <= 0 uses
+// every online core.
+Number sum_many(const Number *numbers, int count, int threads) {
+  if (threads <= 0) {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (threads > count) {
+    threads = count;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  SumTask *tasks = (SumTask *)malloc(threads * sizeof(SumTask));
+  pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if (tasks == NULL || ids == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The workers only read the kernel pointers
+  init_carry_kernels();
+
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, threads);
+
+  for (int t = 0; t < threads; t++) {
+    int from = (int)((long)count * t / threads);
+    int to = (int)((long)count * (t + 1) / threads);
+    tasks[t] = (SumTask){.numbers = numbers + from,
+                         .count = to - from,
+                         .index = t,
+                         .threads = threads,
+                         .tasks = tasks,
+                         .barrier = &barrier};
+  }
+
+  // The calling thread takes the first run, and with it the root of the tree
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&ids[t], NULL, sum_worker, &tasks[t]) != 0) {
+      fprintf(stderr, "Thread creation failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  sum_worker(&tasks[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+    free_number(tasks[t].sum);
+  }
+
+  Number sum = tasks[0].sum;
+  pthread_barrier_destroy(&barrier);
+  free(tasks);
+  free(ids);
+  return sum;
+}
+
+// base^exponent mod modulus for exponent >= 0 and modulus > 0. The result
+// is always in [0, modulus).
+Number mod_pow(Number base, Number exponent, Number modulus) {
+  if (exponent.negative || modulus.negative || modulus.length == 0) {
+    fprintf(stderr, "mod_pow needs exponent >= 0 and modulus > 0\n");
+    exit(EXIT_FAILURE);
+  }
+
+  Number result = {0};
+  Number b = {0};
+  Number t = {0};
+
+  Number one = number_from_limb(1);
+  divide_into(NULL, &result, one, modulus);
+  free_number(one);
+
+  divide_into(NULL, &b, base, modulus);
+  if (b.negative) {
+    add_assign(&b, modulus);
+  }
+
+  // Left to right binary exponentiation, reusing the same three buffers
+  for (int i = exponent.length * LIMB_BITS - 1; i >= 0; i--) {
+    multiply_into(&t, result, result);
+    divide_into(NULL, &result, t, modulus);
+
+    if ((exponent.limbs[i / LIMB_BITS] >> (i % LIMB_BITS)) & 1) {
+      multiply_into(&t, result, b);
+      divide_into(NULL, &result, t, modulus);
+    }
+  }
+
+  free_number(t);
+  free_number(b);
+  return result;
+}
+
+// Below this many limbs the quadratic conversions win
+int conversion_threshold = 30;
+
+// Powers 10^(DECIMAL_DIGITS * 2^k), each the square of the one before, and
+// the reciprocals used to divide by them when printing. They are built on
+// demand and kept per thread like the scratch arena, so repeated
+// conversions of similar sizes reuse them.
+typedef struct {
+  int count;
+  Number powers[32];
+  Number reciprocals[32];
+} DecimalPowers;
+
+_Thread_local DecimalPowers decimal_powers;
+
+Number decimal_power(int k) {
+  while (decimal_powers.count <= k) {
+    int i = decimal_powers.count++;
+    if (i == 0) {
+      decimal_powers.powers[0] = number_from_limb(DECIMAL_BASE);
+    } else {
+      multiply_into(&decimal_powers.powers[i], decimal_powers.powers[i - 1],
+                    decimal_powers.powers[i - 1]);
+    }
+  }
+  return decimal_powers.powers[k];
+}
+
+void free_decimal_powers() {
+  for (int i = 0; i < decimal_powers.count; i++) {
+    free_number(decimal_powers.powers[i]);
+    free_number(decimal_powers.reciprocals[i]);
+  }
+  decimal_powers = (DecimalPowers){0};
+}
+
+// number *= 2^(LIMB_BITS * count)
+void shift_left_limbs(Number *number, int count) {
+  if (number->length == 0) {
+    return;
+  }
+  reserve(number, number->length + count);
+  memmove(number->limbs + count, number->limbs, number->length * sizeof(Limb));
+  memset(number->limbs, 0, count * sizeof(Limb));
+  number->length += count;
+}
+
+// number /= 2^(LIMB_BITS * count), truncating
+void shift_right_limbs(Number *number, int count) {
+  if (number->length <= count) {
+    number->length = 0;
+    number->negative = false;
+    return;
+  }
+  number->length -= count;
+  memmove(number->limbs, number->limbs + count, number->length * sizeof(Limb));
+}
+
+// 2^(LIMB_BITS * count)
+Number limb_power(int count) {
+  Number number = {.length = count + 1, .capacity = count + 1};
+  number.limbs = allocate_limbs(count + 1);
+  memset(number.limbs, 0, count * sizeof(Limb));
+  number.limbs[count] = 1;
+  return number;
+}
+
+// floor(B^(2m) / d) for a positive d of m limbs, where B = 2^LIMB_BITS.
+// Newton's method refines the reciprocal of the top half of d, so the cost
+// is a few multiplications of m limbs rather than a long division.
+Number reciprocal(Number d) {
+  int m = d.length;
+  Number power = limb_power(2 * m);
+  Number result = {0};
+
+  // Two guard limbs keep the error after one step below a unit
+  int h = m / 2 + 2;
+  if (m <= conversion_threshold || h >= m) {
+    divide_into(&result, NULL, power, d);
+    free_number(power);
+    return result;
+  }
+
+  // The reciprocal of the top h limbs, scaled, is within a relative
+  // B^(1 - h) of the answer, and x += x * (B^(2m) - d * x) / B^(2m) squares
+  // that error
+  Number top = {.length = h, .capacity = h, .limbs = d.limbs + m - h};
+  result = reciprocal(top);
+  shift_left_limbs(&result, m - h);
+
+  Number e = {0};
+  Number t = {0};
+  multiply_into(&e, d, result);
+  subtract_into(&e, power, e);
+  multiply_into(&t, result, e);
+  shift_right_limbs(&t, 2 * m);
+  add_assign(&result, t);
+
+  // Settle the last few units so that 0 <= B^(2m) - d * x < d
+  Limb one_limb = 1;
+  Number one = {.length = 1, .capacity = 1, .limbs = &one_limb};
+  multiply_into(&e, d, result);
+  subtract_into(&e, power, e);
+  while (e.negative) {
+    subtract_assign(&result, one);
+    add_assign(&e, d);
+  }
+  while (compare(e, d) >= 0) {
+    add_assign(&result, one);
+    subtract_assign(&e, d);
+  }
+
+  free_number(power);
+  free_number(e);
+  free_number(t);
+  return result;
+}
+
+// q, r = x divmod 10^(DECIMAL_DIGITS * 2^k) for
+// 0 <= x < 10^(DECIMAL_DIGITS * 2^(k + 1)), as a multiplication by the
+// cached reciprocal v = floor(B^(2m) / d). Only the top m + 1 limbs of x
+// take part, which leaves the estimate at most three short.
+void divide_by_power(Number *q, Number *r, Number x, int k) {
+  Number d = decimal_power(k);
+  if (decimal_powers.reciprocals[k].length == 0) {
+    decimal_powers.reciprocals[k] = reciprocal(d);
+  }
+
+  int m = d.length;
+  Number top = {0};
+  if (x.length > m - 1) {
+    top.length = x.length - (m - 1);
+    top.capacity = top.length;
+    top.limbs = x.limbs + m - 1;
+  }
+  multiply_into(q, top, decimal_powers.reciprocals[k]);
+  shift_right_limbs(q, m + 1);
+  multiply_into(r, *q, d);
+  subtract_into(r, x, *r);
+
+  Limb one_limb = 1;
+  Number one = {.length = 1, .capacity = 1, .limbs = &one_limb};
+  while (compare(*r, d) >= 0) {
+    subtract_assign(r, d);
+    add_assign(q, one);
+  }
+}
+
+// Parses a run of decimal digits by splitting off the low
+// DECIMAL_DIGITS * 2^k of them, for the largest k that leaves a nonempty
+// high part, and combining high * 10^(DECIMAL_DIGITS * 2^k) + low
+Number parse_digits(const char *str, int digits) {
+  if (digits / DECIMAL_DIGITS <= conversion_threshold) {
+    return parse_basecase(str, digits);
+  }
+
+  int k = 0;
+  while (((long long)DECIMAL_DIGITS << (k + 1)) < digits) {
+    k++;
+  }
+  int low_digits = DECIMAL_DIGITS << k;
+
+  Number high = parse_digits(str, digits - low_digits);
+  Number low = parse_digits(str + digits - low_digits, low_digits);
+  multiply_into(&high, high, decimal_power(k));
+  add_assign(&high, low);
+  free_number(low);
+  return high;
+}
+
+// Writes the digits of 0 <= x < 10^(DECIMAL_DIGITS * 2^k) at *cursor and
+// advances it. With pad the output is exactly DECIMAL_DIGITS * 2^k digits,
+// zero filled, otherwise it has no leading zeros.
+void format_digits(Number x, int k, bool pad, char **cursor) {
+  if (k == 0 || x.length <= conversion_threshold) {
+    if (pad) {
+      size_t width = (size_t)DECIMAL_DIGITS << k;
+      char *end = *cursor + width;
+      char *p = format_basecase(x.limbs, x.length, end);
+      memset(*cursor, '0', p - *cursor);
+      *cursor = end;
+    } else {
+      char *digits = allocate_string((size_t)x.length * 20);
+      char *end = digits + (size_t)x.length * 20;
+      char *p = format_basecase(x.limbs, x.length, end);
+      memcpy(*cursor, p, end - p);
+      *cursor += end - p;
+      free(digits);
+    }
+    return;
+  }
+
+  Number q = {0};
+  Number r = {0};
+  divide_by_power(&q, &r, x, k - 1);
+  if (pad || q.length > 0) {
+    format_digits(q, k - 1, pad, cursor);
+    format_digits(r, k - 1, true, cursor);
+  } else {
+    format_digits(r, k - 1, false, cursor);
+  }
+  free_number(q);
+  free_number(r);
+}
+
+// Parses length characters of decimal text with an optional leading '-'.
+// The text needn't be terminated, so it can point into a larger buffer.
+Number parse_number(const char *str, int length) {
+  bool negative = length > 0 && *str == '-';
+  if (negative) {
+    str++;
+    length--;
+  }
+
+  Number number = parse_digits(str, length);
+  number.negative = negative && number.length > 0;
+  return number;
+}
+
+Number create_number(const char *str) {
+  return parse_number(str, strlen(str));
+}
+
+char *number_to_string(Number number) {
+  if (number.length == 0) {
+    char *str = allocate_string(2);
+    strcpy(str, "0");
+    return str;
+  }
+
+  // 64 bits never need more than 20 decimal digits, plus room for the sign
+  char *str = allocate_string((size_t)number.length * 20 + 2);
+  char *cursor = str;
+  if (number.negative) {
+    *cursor++ = '-';
+  }
+
+  // Split by the smallest power of the table above |number|
+  Number magnitude = number;
+  magnitude.negative = false;
+  int k = 0;
+  if (number.length > conversion_threshold) {
+    while (compare(magnitude, decimal_power(k)) >= 0) {
+      k++;
+    }
+  }
+
+  format_digits(magnitude, k, false, &cursor);
+  *cursor = '\0';
+  return str;
+}
+
+Number generate_number(int n, int d) {
+  char *str = allocate_string(n + 1);
+  for (int i = 0; i < n; i++) {
+    str[i] = '0' + d;
+  }
+  str[n] = '\0';
+
+  Number number = create_number(str);
+  free(str);
+  return number;
+}
+
+void print_number(const char *label, Number number) {
+  char *str = number_to_string(number);
+  printf("%s%s\n", label, str);
+  free(str);
+}
+
+#ifdef TEST
+void check(const char *label, Number actual, const char *expected) {
+  char *str = number_to_string(actual);
+  if (strcmp(str, expected) != 0) {
+    printf("Test failed: %s\n", label);
+    printf("  Actual:   %s\n", str);
+    printf("  Expected: %s\n", expected);
+    exit(1);
+  }
+  free(str);
+}
+
+Number random_number(uint64_t *state, int length) {
+  Number number = {
+      .length = length, .capacity = length, .negative = *state & 1};
+  number.limbs = allocate_limbs(length);
+  for (int i = 0; i < length; i++) {
+    // xorshift64
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    number.limbs[i] = *state;
+  }
+  // Sparse top limbs make the quotient estimate in limbs_divmod miss
+  if (length > 1 && (*state & 6) == 0) {
+    number.limbs[length - 1] >>= 60;
+  }
+  normalize(&number);
+  return number;
+}
+
+void check_multiply(const char *label, uint64_t *state, int an, int bn,
+                    bool saturated) {
+  Number x = random_number(state, an);
+  Number y = random_number(state, bn);
+  // Saturated limbs push every carry path
+  if (saturated) {
+    memset(x.limbs, 0xff, an * sizeof(Limb));
+    memset(y.limbs, 0xff, bn * sizeof(Limb));
+  }
+
+  Limb *expected = allocate_limbs(an + bn);
+  Limb *actual = allocate_limbs(an + bn);
+  limbs_mul_basecase(expected, x.limbs, an, y.limbs, bn);
+  limbs_mul(actual, x.limbs, an, y.limbs, bn);
+  if (memcmp(expected, actual, (an + bn) * sizeof(Limb)) != 0) {
+    printf("Test failed: %s multiply %dx%d limbs\n", label, an, bn);
+    exit(1);
+  }
+
+  free(expected);
+  free(actual);
+  free_number(x);
+  free_number(y);
+}
+
+int main() {
+  Number a = create_number("-12345678901234567890123456789");
+  Number b = create_number("98765432109876543210");
+
+  {
+    Number result = add(a, b);
+    check("add", result, "-12345678802469135780246913579");
+    free_number(result);
+  }
+
+  {
+    Number result = subtract(a, b);
+    check("subtract", result, "-12345678999999999999999999999");
+    free_number(result);
+  }
+
+  {
+    Number result = subtract(a, a);
+    check("subtract to zero", result, "0");
+    free_number(result);
+  }
+
+  {
+    Number result = multiply(a, b);
+    check("multiply", result,
+          "-1219326311370217952249657064223746380111126352690");
+    free_number(result);
+  }
+
+  {
+    if (compare(a, b) >= 0 || compare(b, a) <= 0 || compare(a, a) != 0) {
+      printf("Test failed: compare\n");
+      exit(1);
+    }
+  }
+
+  {
+    // 2^192 - 1 divided by 2^128 + 12345
+    Number x = create_number(
+        "6277101735386680763835789423207666416102355444464034512895");
+    Number y = create_number("340282366920938463463374607431768223801");
+    Number q, r;
+    divide(x, y, &q, &r);
+    check("divide quotient", q, "18446744073709551615");
+    check("divide remainder", r, "340282366920938235738319017487353524280");
+    free_number(x);
+    free_number(y);
+    free_number(q);
+    free_number(r);
+  }
+
+  {
+    // Operands where the quotient estimate is one too large and the
+    // divisor has to be added back
+    Number x = create_number("5789604461865809770864694163665061354471709762"
+                             "1216448811677614281724547563520");
+    Number y = create_number("3138550867693340381917894711603833208051177722"
+                             "232017256449");
+    Number q, r;
+    divide(x, y, &q, &r);
+    check("divide add back quotient", q, "18446744073709551614");
+    check("divide add back remainder", r,
+          "3138550867693340381917894711603833208032730978158307704834");
+    free_number(x);
+    free_number(y);
+    free_number(q);
+    free_number(r);
+  }
+
+  {
+    Number x = create_number("-7");
+    Number y = create_number("2");
+    Number q, r;
+    divide(x, y, &q, &r);
+    check("truncating quotient", q, "-3");
+    check("truncating remainder", r, "-1");
+    free_number(x);
+    free_number(y);
+    free_number(q);
+    free_number(r);
+  }
+
+  {
+    Number base = create_number("3");
+    Number exponent = create_number("100000000000000000000");
+    Number modulus = create_number("1000000007");
+    Number result = mod_pow(base, exponent, modulus);
+    check("mod_pow", result, "139421235");
+    free_number(base);
+    free_number(exponent);
+    free_number(modulus);
+    free_number(result);
+  }
+
+  {
+    Number base = create_number("-7");
+    Number exponent = create_number("13");
+    Number modulus = create_number("1000000000000000000000000000057");
+    Number result = mod_pow(base, exponent, modulus);
+    check("mod_pow negative base", result, "999999999999999999903110989650");
+    free_number(base);
+    free_number(exponent);
+    free_number(modulus);
+    free_number(result);
+  }
+
+  // Every carry kernel the CPU supports against the portable loops. Operands
+  // mix complements, equal limbs and random limbs so that carries and
+  // borrows both stop and run through whole blocks.
+  {
+    uint64_t state = 6364136223846793005ULL;
+    Limb a[70], b[70], expected[70], actual[70];
+    for (int k = 0; k < CARRY_KERNEL_COUNT; k++) {
+      if (!carry_kernel_supported(&carry_kernels[k])) {
+        continue;
+      }
+      for (int n = 0; n <= 70; n++) {
+        Number x = random_number(&state, 70);
+        Number y = random_number(&state, 70);
+        for (int i = 0; i < n; i++) {
+          a[i] = x.limbs[i];
+          b[i] = (y.limbs[i] % 3 == 0)   ? ~a[i]
+                 : (y.limbs[i] % 3 == 1) ? a[i]
+                                         : y.limbs[i];
+        }
+        free_number(x);
+        free_number(y);
+
+        CarryKernel kernels[][2] = {
+            {limbs_add_n_scalar, carry_kernels[k].add},
+            {limbs_sub_n_scalar, carry_kernels[k].sub}};
+        for (int j = 0; j < 2; j++) {
+          Limb expected_carry = kernels[j][0](expected, a, b, n);
+          Limb actual_carry = kernels[j][1](actual, a, b, n);
+          if (expected_carry != actual_carry ||
+              memcmp(expected, actual, n * sizeof(Limb)) != 0) {
+            printf("Test failed: %s %s kernel, %d limbs\n",
+                   carry_kernels[k].name, j == 0 ? "add" : "sub", n);
+            exit(1);
+          }
+        }
+      }
+    }
+  }
+
+  // Karatsuba and Toom-3 against schoolbook, with small thresholds so the
+  // recursion goes several levels deep
+  karatsuba_threshold = 4;
+  toom3_threshold = 12;
+  {
+    uint64_t state = 2463534242ULL;
+    int sizes[][2] = {{5, 5},   {7, 7},     {12, 12},  {13, 13}, {40, 40},
+                      {97, 97}, {300, 300}, {100, 31}, {257, 64}};
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+      check_multiply("toom3", &state, sizes[i][0], sizes[i][1], i % 2 == 1);
+    }
+  }
+
+  // The NTT against schoolbook, including saturated operands that produce
+  // the largest possible convolution terms
+  ntt_threshold = 8;
+  {
+    uint64_t state = 3141592653ULL;
+    int sizes[][2] = {{8, 8},       {9, 9},       {33, 33},   {100, 9},
+                      {1000, 1000}, {3000, 3000}, {4000, 777}};
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+      check_multiply("ntt", &state, sizes[i][0], sizes[i][1], i % 2 == 1);
+    }
+
+    Number x = random_number(&state, 2000);
+    Limb *expected = allocate_limbs(2 * x.length);
+    Limb *actual = allocate_limbs(2 * x.length);
+    limbs_mul_basecase(expected, x.limbs, x.length, x.limbs, x.length);
+    limbs_mul(actual, x.limbs, x.length, x.limbs, x.length);
+    if (memcmp(expected, actual, 2 * x.length * sizeof(Limb)) != 0) {
+      printf("Test failed: ntt square\n");
+      exit(1);
+    }
+    free(expected);
+    free(actual);
+    free_number(x);
+  }
+  karatsuba_threshold = 32;
+  toom3_threshold = 160;
+  ntt_threshold = 32768;
+
+  // Once warmed up, a chain of in-place operations allocates nothing
+  {
+    uint64_t state = 1181783497276652981ULL;
+    Number x = random_number(&state, 300);
+    Number y = random_number(&state, 200);
+    Number sum = {0};
+    Number product = {0};
+    Number quotient = {0};
+    Number remainder = {0};
+
+    long warm = 0;
+    for (int round = 0; round < 2; round++) {
+      if (round == 1) {
+        warm = allocations;
+      }
+      for (int i = 0; i < 10; i++) {
+        add_assign(&sum, x);
+        multiply_into(&product, sum, y);
+        multiply_assign(&product, product);
+        divide_into(&quotient, &remainder, product, y);
+        subtract_assign(&sum, x);
+        subtract_into(&remainder, remainder, remainder);
+      }
+    }
+
+    if (allocations != warm || sum.length != 0) {
+      printf("Test failed: %ld allocations after warm-up\n",
+             allocations - warm);
+      exit(1);
+    }
+
+    free_number(x);
+    free_number(y);
+    free_number(sum);
+    free_number(product);
+    free_number(quotient);
+    free_number(remainder);
+  }
+
+  {
+    // Results may overwrite their operands
+    Number x = create_number("123456789012345678901234567890");
+    Number y = create_number("-987654321");
+    Number z = copy_number(x);
+    divide_into(&z, &y, z, y);
+    check("aliased quotient", z, "-124999998873437499901");
+    check("aliased remainder", y, "574845669");
+    multiply_into(&x, x, x);
+    check("aliased square", x,
+          "15241578753238836750495351562536198787501905199875019052100");
+    free_number(x);
+    free_number(y);
+    free_number(z);
+  }
+
+  {
+    // sum_many() against a serial fold, with saturated operands among them
+    // so the deferred carries pile up
+    uint64_t state = 1181783497276652981ULL;
+    int count = 200;
+    Number numbers[200];
+    Number expected = {0};
+    for (int i = 0; i < count; i++) {
+      numbers[i] = random_number(&state, 1 + i % 23);
+      if (i % 5 == 0) {
+        memset(numbers[i].limbs, 0xff, numbers[i].capacity * sizeof(Limb));
+        numbers[i].length = numbers[i].capacity;
+      }
+      add_assign(&expected, numbers[i]);
+    }
+
+    int threads[] = {1, 2, 3, 8, 0};
+    for (int i = 0; i < 5; i++) {
+      Number sum = sum_many(numbers, count, threads[i]);
+      if (compare(sum, expected) != 0) {
+        printf("Test failed: sum_many with %d threads\n", threads[i]);
+        exit(1);
+      }
+      free_number(sum);
+    }
+
+    Number sum = sum_many(numbers, 0, 4);
+    check("empty sum", sum, "0");
+    free_number(sum);
+
+    for (int i = 0; i < count; i++) {
+      free_number(numbers[i]);
+    }
+    free_number(expected);
+  }
+
+  {
+    // Divide and conquer conversions against the quadratic ones, with the
+    // threshold low enough to recurse a few levels
+    int saved = conversion_threshold;
+    conversion_threshold = 2;
+    uint64_t state = 2463534242ULL;
+
+    for (int length = 1; length < 120; length += 1 + length / 4) {
+      Number x = random_number(&state, length);
+      if (x.length == 0) {
+        free_number(x);
+        continue;
+      }
+
+      Number d = x;
+      d.negative = false;
+      Number power = limb_power(2 * d.length);
+      Number expected = {0};
+      divide_into(&expected, NULL, power, d);
+      Number inverse = reciprocal(d);
+      if (compare(inverse, expected) != 0) {
+        printf("Test failed: reciprocal of %d limbs\n", d.length);
+        exit(1);
+      }
+      free_number(power);
+      free_number(expected);
+      free_number(inverse);
+
+      char *str = number_to_string(x);
+      char *digits = allocate_string((size_t)x.length * 20 + 1);
+      char *end = digits + (size_t)x.length * 20;
+      *end = '\0';
+      char *p = format_basecase(x.limbs, x.length, end);
+      if (strcmp(str + x.negative, p) != 0) {
+        printf("Test failed: format of %d limbs\n", x.length);
+        exit(1);
+      }
+
+      Number y = create_number(str);
+      Number z = parse_basecase(p, end - p);
+      z.negative = x.negative;
+      if (compare(x, y) != 0 || compare(x, z) != 0) {
+        printf("Test failed: parse of %d limbs\n", x.length);
+        exit(1);
+      }
+
+      free(str);
+      free(digits);
+      free_number(x);
+      free_number(y);
+      free_number(z);
+    }
+
+    // Long runs of zeros and nines fall on the padded boundaries
+    char digits[2001];
+    for (int n = 1; n < 2000; n += 37) {
+      memset(digits, '0', n);
+      digits[0] = '1';
+      digits[n] = '\0';
+      Number x = create_number(digits);
+      check("power of ten", x, digits);
+      free_number(x);
+
+      memset(digits, '9', n);
+      x = create_number(digits);
+      check("power of ten less one", x, digits);
+      free_number(x);
+
+      memset(digits, '0', n);
+      digits[0] = '7';
+      digits[n - 1] = '3';
+      x = parse_number(digits, n);
+      check("sparse digits", x, n > 1 ? digits : "3");
+      free_number(x);
+    }
+
+    conversion_threshold = saved;
+    free_decimal_powers();
+  }
+
+  // a == q * b + r with |r| < |b| over random operands
+  uint64_t state = 88172645463325252ULL;
+  for (int i = 0; i < 1000; i++) {
+    Number x = random_number(&state, 1 + i % 17);
+    Number y = random_number(&state, 1 + i % 7);
+    if (y.length == 0) {
+      free_number(x);
+      free_number(y);
+      continue;
+    }
+
+    Number q, r;
+    divide(x, y, &q, &r);
+    Number product = multiply(q, y);
+    Number sum = add(product, r);
+
+    if (compare(sum, x) != 0 ||
+        limbs_cmp(r.limbs, r.length, y.limbs, y.length) >= 0) {
+      printf("Test failed: random division %d\n", i);
+      exit(1);
+    }
+
+    free_number(x);
+    free_number(y);
+    free_number(q);
+    free_number(r);
+    free_number(product);
+    free_number(sum);
+  }
+
+  free_number(a);
+  free_number(b);
+
+  printf("All tests passed!\n");
+}
+#elif defined(BENCHMARK)
+#include <sys/resource.h>
+#include <time.h>
+
+typedef void (*MulKernel)(Limb *r, const Limb *a, const Limb *b, int n);
+
+void mul_basecase_n(Limb *r, const Limb *a, const Limb *b, int n) {
+  limbs_mul_basecase(r, a, n, b, n);
+}
+
+void mul_ntt_n(Limb *r, const Limb *a, const Limb *b, int n) {
+  limbs_mul_ntt(r, a, n, b, n);
+}
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seconds per call, repeating until the measurement is long enough to trust
+double time_kernel(MulKernel kernel, Limb *r, const Limb *a, const Limb *b,
+                   int n) {
+  for (int repeats = 1;; repeats *= 2) {
+    double start = now_seconds();
+    for (int i = 0; i < repeats; i++) {
+      kernel(r, a, b, n);
+    }
+    double elapsed = now_seconds() - start;
+    if (elapsed > 0.02) {
+      return elapsed / repeats;
+    }
+  }
+}
+
+// Walks n upwards from `from` and returns the first size at which `fast`
+// beats `slow` twice in a row. The threshold variable is set to n before
+// each measurement, so the recursion below the top level uses the slower
+// algorithm as it would just above the crossover.
+int find_crossover(const char *slow_name, MulKernel slow,
+                   const char *fast_name, MulKernel fast, int *threshold,
+                   int from, int to) {
+  int max = to * 2;
+  Limb *a = allocate_limbs(max);
+  Limb *b = allocate_limbs(max);
+  Limb *r = allocate_limbs(2 * max);
+  for (int i = 0; i < max; i++) {
+    a[i] = 0x9E3779B97F4A7C15ULL * (i + 1);
+    b[i] = 0xC2B2AE3D27D4EB4FULL * (i + 1);
+  }
+
+  printf("%8s %14s %14s\n", "limbs", slow_name, fast_name);
+
+  int crossover = 0;
+  int wins = 0;
+  int n = from;
+  for (; n <= to && wins < 2; n += (n / 8 > 1) ? n / 8 : 1) {
+    *threshold = n;
+    double slow_time = time_kernel(slow, r, a, b, n);
+    double fast_time = time_kernel(fast, r, a, b, n);
+    printf("%8d %12.2fus %12.2fus\n", n, slow_time * 1e6, fast_time * 1e6);
+
+    if (fast_time < slow_time) {
+      if (wins++ == 0) {
+        crossover = n;
+      }
+    } else {
+      wins = 0;
+    }
+  }
+
+  free(a);
+  free(b);
+  free(r);
+
+  if (wins < 2) {
+    printf("No crossover below %d limbs\n", to);
+    return to;
+  }
+  return crossover;
+}
+
+// ns per limb of every supported carry kernel, in and out of cache
+void benchmark_carry_kernels() {
+  int sizes[] = {1000, 100000, 10000000};
+  printf("%8s", "limbs");
+  for (int k = 0; k < CARRY_KERNEL_COUNT; k++) {
+    if (carry_kernel_supported(&carry_kernels[k])) {
+      printf(" %12s", carry_kernels[k].name);
+    }
+  }
+  printf("\n");
+
+  for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+    int n = sizes[i];
+    Limb *a = allocate_limbs(n);
+    Limb *r = allocate_limbs(n);
+    for (int j = 0; j < n; j++) {
+      a[j] = 0x9E3779B97F4A7C15ULL * (j + 1);
+    }
+    memset(r, 0, n * sizeof(Limb));
+
+    printf("%8d", n);
+    for (int k = 0; k < CARRY_KERNEL_COUNT; k++) {
+      if (!carry_kernel_supported(&carry_kernels[k])) {
+        continue;
+      }
+      double elapsed = 0;
+      int repeats = 1;
+      for (; elapsed < 0.05; repeats *= 2) {
+        double start = now_seconds();
+        for (int j = 0; j < repeats; j++) {
+          carry_kernels[k].add(r, a, r, n);
+        }
+        elapsed = now_seconds() - start;
+      }
+      printf(" %8.3fns/l", elapsed / (repeats / 2) / n * 1e9);
+    }
+    printf("\n");
+
+    free(a);
+    free(r);
+  }
+}
+
+// Operands for one size of the suite: a and b have the given number of
+// digits and text holds the digits of a
+typedef struct {
+  int digits;
+  char *text;
+  Number a;
+  Number b;
+  Number result;
+} Operands;
+
+typedef void (*Operation)(Operands *operands);
+
+void operation_add(Operands *operands) {
+  Number result = add(operands->a, operands->b);
+  free_number(result);
+}
+
+void operation_add_into(Operands *operands) {
+  add_into(&operands->result, operands->a, operands->b);
+}
+
+void operation_multiply(Operands *operands) {
+  Number result = multiply(operands->a, operands->b);
+  free_number(result);
+}
+
+void operation_parse(Operands *operands) {
+  Number result = parse_number(operands->text, operands->digits);
+  free_number(result);
+}
+
+void operation_print(Operands *operands) {
+  free(number_to_string(operands->a));
+}
+
+typedef struct {
+  const char *name;
+  Operation run;
+} BenchmarkOperation;
+
+BenchmarkOperation operations[] = {
+    {"add", operation_add},
+    {"add_into", operation_add_into},
+    {"multiply", operation_multiply},
+    {"parse", operation_parse},
+    {"print", operation_print},
+};
+
+#define OPERATION_COUNT (int)(sizeof(operations) / sizeof(operations[0]))
+
+// Peak resident set of the process so far in KiB. It never goes down, so
+// with sizes run in increasing order it tracks the largest one.
+long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+char *random_digits(int digits, uint64_t *state) {
+  char *text = allocate_string(digits + 1);
+  for (int i = 0; i < digits; i++) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    text[i] = '0' + *state % 10;
+  }
+  text[0] = '1' + *state % 9;
+  text[digits] = '\0';
+  return text;
+}
+
+// Times every operation at sizes from 10 digits up to max_digits, growing
+// tenfold, as a table or as CSV. Allocations are the limb buffers counted by
+// allocations, after one untimed call has warmed the caches.
+void benchmark_suite(int max_digits, bool csv) {
+  if (csv) {
+    printf("operation,digits,repeats,seconds_per_op,ns_per_digit,"
+           "allocations_per_op,peak_rss_kb\n");
+  } else {
+    printf("%-10s %10s %8s %14s %12s %10s %12s\n", "operation", "digits",
+           "repeats", "time/op", "ns/digit", "allocs/op", "peak rss");
+  }
+
+  uint64_t state = 88172645463325252ULL;
+  for (long digits = 10; digits <= max_digits; digits *= 10) {
+    Operands operands = {.digits = (int)digits};
+    operands.text = random_digits(digits, &state);
+    char *other = random_digits(digits, &state);
+    operands.a = create_number(operands.text);
+    operands.b = create_number(other);
+    free(other);
+
+    for (int k = 0; k < OPERATION_COUNT; k++) {
+      operations[k].run(&operands);
+
+      long before = allocations;
+      double elapsed = 0;
+      int repeats = 0;
+      double start = now_seconds();
+      for (int batch = 1; elapsed < 0.2; batch *= 2) {
+        for (int i = 0; i < batch; i++) {
+          operations[k].run(&operands);
+        }
+        repeats += batch;
+        elapsed = now_seconds() - start;
+      }
+
+      double per_op = elapsed / repeats;
+      double per_allocations = (double)(allocations - before) / repeats;
+      if (csv) {
+        printf("%s,%ld,%d,%.9g,%.4g,%.3g,%ld\n", operations[k].name, digits,
+               repeats, per_op, per_op / digits * 1e9, per_allocations,
+               peak_rss_kb());
+      } else {
+        printf("%-10s %10ld %8d %12.3fus %12.3f %10.2f %10ldKB\n",
+               operations[k].name, digits, repeats, per_op * 1e6,
+               per_op / digits * 1e9, per_allocations, peak_rss_kb());
+      }
+      fflush(stdout);
+    }
+
+    free(operands.text);
+    free_number(operands.a);
+    free_number(operands.b);
+    free_number(operands.result);
+  }
+}
+
+void usage(char *name) {
+  printf("Usage: %s [options]\n", name);
+  printf("\n");
+  printf("Options:\n");
+  printf("  -h, --help            Show this help message\n");
+  printf("  -c, --csv             Print the suite as CSV\n");
+  printf("  -m, --max-digits <n>  Largest operand size, default 10^7\n");
+  printf("  -t, --thresholds      Compare the carry kernels and measure\n");
+  printf("                        the multiplication crossovers instead\n");
+  printf("\n");
+}
+
+void benchmark_thresholds() {
+  benchmark_carry_kernels();
+  printf("\n");
+
+  int karatsuba = find_crossover("schoolbook", mul_basecase_n, "karatsuba",
+                                 limbs_mul_karatsuba, &karatsuba_threshold, 4,
+                                 512);
+  karatsuba_threshold = karatsuba;
+  printf("\n");
+
+  int toom3 = find_crossover("karatsuba", limbs_mul_karatsuba, "toom3",
+                             limbs_mul_toom3, &toom3_threshold, karatsuba,
+                             4096);
+  toom3_threshold = toom3;
+  printf("\n");
+
+  int ntt = find_crossover("toom3", limbs_mul_toom3, "ntt", mul_ntt_n,
+                           &ntt_threshold, toom3, 131072);
+  ntt_threshold = ntt;
+  printf("\n");
+
+  printf("karatsuba_threshold = %d\n", karatsuba);
+  printf("toom3_threshold = %d\n", toom3);
+  printf("ntt_threshold = %d\n", ntt);
+}
+
+int main(int argc, char *argv[]) {
+  int max_digits = 10000000;
+  bool csv = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+      return 0;
+    } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (strcmp(argv[i], "-m") == 0 ||
+               strcmp(argv[i], "--max-digits") == 0) {
+      if (i + 1 < argc) {
+        max_digits = atoi(argv[++i]);
+      } else {
+        fprintf(stderr, "Error: Missing digit count\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-t") == 0 ||
+               strcmp(argv[i], "--thresholds") == 0) {
+      benchmark_thresholds();
+      return 0;
+    } else {
+      fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  benchmark_suite(max_digits, csv);
+  return 0;
+}
+#else
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// parse_number() takes an int length, sign included
+#define MAX_OPERAND_DIGITS (INT32_MAX - 1)
+
+void usage(char *name) {
+  printf("Usage: %s [options] <token>...\n", name);
+  printf("\n");
+  printf("Evaluates a reverse Polish expression and prints the result.\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("  -h, --help   Show this help message\n");
+  printf("  -s, --stats  Report sizes, times and digits/second on stderr\n");
+  printf("\n");
+  printf("Tokens:\n");
+  printf("  <integer>    A decimal literal, optionally negative\n");
+  printf("  @<file>      A decimal integer read from a file\n");
+  printf("  @-           A decimal integer read from stdin\n");
+  printf("  + - x /  %%   Add, subtract, multiply, divide and remainder\n");
+  printf("               (x or *; / and %% truncate toward zero)\n");
+  printf("  powmod       base exponent modulus -> base^exponent mod modulus\n");
+  printf("  sum          Replace the whole stack with its sum\n");
+  printf("\n");
+  printf("Operands may have up to %d digits.\n", MAX_OPERAND_DIGITS);
+  printf("\n");
+  printf("Example: %s @a.txt @b.txt x 1000000007 %%\n", name);
+  printf("\n");
+}
+
+double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The text of an operand file. Regular files are mapped instead of read, so
+// the text is paged in as the parser walks it and never has to fit in
+// memory next to the number. Pipes and terminals are read into a buffer.
+typedef struct {
+  const char *text;
+  size_t length;
+  void *map;
+  char *buffer;
+} Source;
+
+Source open_source(const char *path) {
+  Source source = {0};
+  int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Cannot open '%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      source.text = (const char *)map;
+      source.length = st.st_size;
+      source.map = map;
+    }
+  }
+
+  if (source.map == NULL) {
+    size_t capacity = 1 << 16;
+    source.buffer = (char *)malloc(capacity);
+    ssize_t n;
+    while (source.buffer != NULL &&
+           (n = read(fd, source.buffer + source.length,
+                     capacity - source.length)) > 0) {
+      source.length += n;
+      if (source.length == capacity) {
+        capacity *= 2;
+        source.buffer = (char *)realloc(source.buffer, capacity);
+      }
+    }
+    if (source.buffer == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    source.text = source.buffer;
+  }
+
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  return source;
+}
+
+void close_source(Source source) {
+  if (source.map != NULL) {
+    munmap(source.map, source.length);
+  }
+  free(source.buffer);
+}
+
+// Parses text as a decimal integer with an optional '-', ignoring
+// surrounding whitespace. Returns the number of digits, -1 if the text
+// isn't an integer, or -2 if it has more than MAX_OPERAND_DIGITS digits.
+long parse_operand(const char *text, size_t length, Number *number) {
+  while (length > 0 && isspace((unsigned char)text[0])) {
+    text++;
+    length--;
+  }
+  while (length > 0 && isspace((unsigned char)text[length - 1])) {
+    length--;
+  }
+
+  size_t sign = length > 0 && *text == '-';
+  if (length == sign) {
+    return -1;
+  }
+  for (size_t i = sign; i < length; i++) {
+    if (text[i] < '0' || text[i] > '9') {
+      return -1;
+    }
+  }
+  if (length - sign > MAX_OPERAND_DIGITS) {
+    return -2;
+  }
+
+  *number = parse_number(text, (int)length);
+  return length - sign;
+}
+
+int main(int argc, char *argv[]) {
+  bool stats = false;
+  Number *stack = (Number *)malloc(argc * sizeof(Number));
+  int depth = 0;
+
+  long digits_in = 0;
+  double parse_time = 0;
+  double compute_time = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *token = argv[i];
+    int arity = 0;
+    if (strcmp(token, "+") == 0 || strcmp(token, "-") == 0 ||
+        strcmp(token, "x") == 0 || strcmp(token, "*") == 0 ||
+        strcmp(token, "/") == 0 || strcmp(token, "%") == 0) {
+      arity = 2;
+    } else if (strcmp(token, "powmod") == 0) {
+      arity = 3;
+    } else if (strcmp(token, "sum") == 0) {
+      arity = 1;
+    }
+
+    if (strcmp(token, "-h") == 0 || strcmp(token, "--help") == 0) {
+      usage(argv[0]);
+      return 0;
+    } else if (strcmp(token, "-s") == 0 || strcmp(token, "--stats") == 0) {
+      stats = true;
+    } else if (arity > 0) {
+      if (depth < arity) {
+        fprintf(stderr, "Error: '%s' needs %d operands\n", token, arity);
+        return 1;
+      }
+
+      double start = now_seconds();
+      Number *x = &stack[depth - arity];
+      if (strcmp(token, "sum") == 0) {
+        Number sum = sum_many(stack, depth, 0);
+        for (int j = 0; j < depth; j++) {
+          free_number(stack[j]);
+        }
+        stack[0] = sum;
+        depth = 1;
+      } else if (strcmp(token, "powmod") == 0) {
+        Number result = mod_pow(x[0], x[1], x[2]);
+        free_number(x[0]);
+        x[0] = result;
+      } else if (strcmp(token, "+") == 0) {
+        add_assign(&x[0], x[1]);
+      } else if (strcmp(token, "-") == 0) {
+        subtract_assign(&x[0], x[1]);
+      } else if (strcmp(token, "/") == 0) {
+        divide_into(&x[0], NULL, x[0], x[1]);
+      } else if (strcmp(token, "%") == 0) {
+        divide_into(NULL, &x[0], x[0], x[1]);
+      } else {
+        multiply_assign(&x[0], x[1]);
+      }
+      compute_time += now_seconds() - start;
+
+      if (arity > 1) {
+        for (int j = 1; j < arity; j++) {
+          free_number(x[j]);
+        }
+        depth -= arity - 1;
+      }
+    } else {
+      double start = now_seconds();
+      Source source = {.text = token, .length = strlen(token)};
+      if (token[0] == '@') {
+        source = open_source(token + 1);
+      }
+
+      long digits = parse_operand(source.text, source.length, &stack[depth]);
+      if (digits == -2) {
+        fprintf(stderr, "Error: '%s' has more than %d digits\n", token,
+                MAX_OPERAND_DIGITS);
+        return 1;
+      } else if (digits < 0) {
+        fprintf(stderr, "Error: '%s' is not an integer\n", token);
+        return 1;
+      }
+      depth++;
+      digits_in += digits;
+
+      if (token[0] == '@') {
+        close_source(source);
+      }
+      parse_time += now_seconds() - start;
+    }
+  }
+
+  if (depth != 1) {
+    fprintf(stderr, "Error: Expression leaves %d values\n", depth);
+    return 1;
+  }
+
+  double start = now_seconds();
+  char *str = number_to_string(stack[0]);
+  size_t length = strlen(str);
+  fwrite(str, 1, length, stdout);
+  fputc('\n', stdout);
+  fflush(stdout);
+  double format_time = now_seconds() - start;
+
+  if (stats) {
+    long digits_out = length - stack[0].negative;
+    fprintf(stderr, "read    %12ld digits %10.3fs %10.3g digits/s\n",
+            digits_in, parse_time, digits_in / parse_time);
+    fprintf(stderr, "compute %12s        %10.3fs\n", "", compute_time);
+    fprintf(stderr, "write   %12ld digits %10.3fs %10.3g digits/s\n",
+            digits_out, format_time, digits_out / format_time);
+    fprintf(stderr, "total   %12ld digits %10.3fs %10.3g digits/s\n",
+            digits_in + digits_out, parse_time + compute_time + format_time,
+            (digits_in + digits_out) /
+                (parse_time + compute_time + format_time));
   }
 
+  free(str);
+  free_number(stack[0]);
+  free(stack);
+  free_decimal_powers();
+  arena_free(&scratch);
   return 0;
 }
+#endif
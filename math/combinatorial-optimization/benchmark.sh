@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Runs every engine on the instances from samples/build.sh and reports the
+# time, peak memory and table cells (items x capacity) per second of each.
+# Engines that build a table are skipped past max_cells, and every run is
+# stopped after the timeout, in seconds. Runs on input an engine can't take,
+# like weights past int for the knapsack engines, show as failed.
+#
+# Usage: ./benchmark.sh [timeout] [max_cells]
+
+timeout=${1:-30}
+max_cells=${2:-20000000000}
+
+./build.sh || exit 1
+if [ ! -f samples/hard/index.txt ]; then
+  (cd samples && ./build.sh) || exit 1
+fi
+
+engines=("-e table" "-e table -v" "-e table -t 0" "-e hirschberg"
+         "-e bnb" "-e bnb -n" "-s" "-s -v" "-s -e mitm")
+
+printf "%-38s %-14s %10s %10s %12s\n" "instance" "engine" "seconds" "MiB" \
+  "cells/s"
+
+while read -r file capacity; do
+  path="samples/hard/$file"
+  n=$(wc -l < "$path")
+
+  for engine in "${engines[@]}"; do
+    input="$path"
+    case "$engine" in
+    -s*)
+      # Subset sum reads the weights alone, on the subset sum class
+      [[ "$file" == subset-sum-* ]] || continue
+      input=$(mktemp)
+      cut -d' ' -f1 "$path" > "$input"
+      ;;
+    esac
+
+    result=""
+    if [[ "$engine" == *mitm* ]] && [ "$n" -gt 64 ]; then
+      result="too many items"
+    elif [[ "$engine" != *bnb* && "$engine" != *mitm* ]] &&
+      [ $((n * (capacity + 1))) -gt "$max_cells" ]; then
+      result="skipped"
+    else
+      stats=$(timeout "$timeout" ./build/knapsack --stats -c "$capacity" \
+        $engine -i "$input" 2>&1 > /dev/null)
+      status=$?
+      if [ $status -eq 124 ]; then
+        result="timeout"
+      elif [ $status -ne 0 ]; then
+        result="failed"
+      fi
+    fi
+
+    [ "$input" != "$path" ] && rm -f "$input"
+
+    if [ -n "$result" ]; then
+      printf "%-38s %-14s %10s\n" "$file" "$engine" "$result"
+      continue
+    fi
+
+    seconds=$(awk '/^Time/ { print $3 }' <<< "$stats")
+    mib=$(awk '/^Peak memory/ { print $4 }' <<< "$stats")
+    cells=$(awk -v n="$n" -v c="$capacity" -v s="$seconds" \
+      'BEGIN { printf "%.3e", n * (c + 1) / (s > 0 ? s : 1e-9) }')
+    printf "%-38s %-14s %10s %10s %12s\n" "$file" "$engine" "$seconds" \
+      "$mib" "$cells"
+  done
+done < samples/hard/index.txt
@@ -1,7 +1,16 @@
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 typedef struct Item {
   int weight;
@@ -15,6 +24,39 @@ typedef struct KnapsackSolution {
   int remaining_capacity;
 } KnapsackSolution;
 
+// Items and solutions for values (or weights) past the range of int. The
+// int versions stay the fast path, with twice the cells per vector.
+typedef struct Item64 {
+  int64_t weight;
+  int64_t value;
+} Item64;
+
+typedef struct KnapsackSolution64 {
+  Item64 *selected;
+  int n;
+  int64_t value;
+  int64_t remaining_capacity;
+  // Set, with nothing else filled in, when the values could overflow
+  bool overflow;
+} KnapsackSolution64;
+
+// An item that can be taken up to count times
+typedef struct BoundedItem {
+  int weight;
+  int value;
+  int count;
+} BoundedItem;
+
+// counts[i] copies of item i, for the bounded and unbounded variants
+typedef struct BoundedSolution {
+  int *counts;
+  int n;
+  int value;
+  int remaining_capacity;
+  // Set, with nothing else filled in, when the values could overflow
+  bool overflow;
+} BoundedSolution;
+
 typedef struct SubsetSumSolution {
   int *selected;
   int n;
@@ -22,8 +64,121 @@ typedef struct SubsetSumSolution {
   int remaining_capacity;
 } SubsetSumSolution;
 
+typedef struct SubsetSumSolution64 {
+  int64_t *selected;
+  int n;
+  int64_t value;
+  int64_t remaining_capacity;
+} SubsetSumSolution64;
+
+#define WORD_BITS 64
+
+int bitsetWords(int bits) { return (bits + WORD_BITS - 1) / WORD_BITS; }
+
+// Row update kernels: next[w] = max(prev[w], prev[w - weight] + value) for
+// w in [from, to), setting bit w of take (when it isn't NULL) where the item
+// is taken. They walk down from to, so prev may be next for an in-place
+// update of a single rolling row.
+typedef void (*RowKernel)(const int *prev, int *next, uint64_t *take,
+                          int from, int to, int weight, int value);
+
+void rowScalar(const int *prev, int *next, uint64_t *take, int from, int to,
+               int weight, int value) {
+  int w = to - 1;
+  for (; w >= from && w >= weight; w--) {
+    // Strictly better only, so ties keep the item out
+    if (prev[w - weight] + value > prev[w]) {
+      next[w] = prev[w - weight] + value;
+      if (take != NULL) {
+        take[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+      }
+    } else {
+      next[w] = prev[w];
+    }
+  }
+  if (next != prev) {
+    for (; w >= from; w--) {
+      next[w] = prev[w];
+    }
+  }
+}
+
+#if defined(__x86_64__)
+// Eight cells at a time with vpmaxsd, and the compare mask as one byte of
+// take. A block loads everything it reads before its store and only reads
+// cells at or below its own, so in place it still sees the previous row.
+__attribute__((target("avx2"))) void rowAvx2(const int *prev, int *next,
+                                             uint64_t *take, int from, int to,
+                                             int weight, int value) {
+  int low = from > weight ? from : weight;
+  // Blocks start on multiples of 8 so their masks line up with bytes
+  int top = to & ~7;
+  int bottom = (low + 7) & ~7;
+  if (top <= bottom) {
+    rowScalar(prev, next, take, from, to, weight, value);
+    return;
+  }
+
+  rowScalar(prev, next, take, top, to, weight, value);
+
+  const __m256i add = _mm256_set1_epi32(value);
+  uint8_t *bytes = (uint8_t *)take;
+  for (int w = top - 8; w >= bottom; w -= 8) {
+    __m256i old = _mm256_loadu_si256((const __m256i *)(prev + w));
+    __m256i with = _mm256_add_epi32(
+        _mm256_loadu_si256((const __m256i *)(prev + w - weight)), add);
+    if (take != NULL) {
+      __m256i taken = _mm256_cmpgt_epi32(with, old);
+      bytes[w / 8] |= _mm256_movemask_ps(_mm256_castsi256_ps(taken));
+    }
+    _mm256_storeu_si256((__m256i *)(next + w), _mm256_max_epi32(old, with));
+  }
+
+  rowScalar(prev, next, take, from, bottom, weight, value);
+}
+#endif
+
+RowKernel rowKernel = NULL;
+
+// The fastest kernel the CPU supports, picked on first use
+RowKernel selectRowKernel() {
+  if (rowKernel == NULL) {
+    rowKernel = rowScalar;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+      rowKernel = rowAvx2;
+    }
+#endif
+  }
+  return rowKernel;
+}
+
+// Follows the take bits of a decision table with n rows of words words back
+// from the cell at capacity. Cells only depend on the ones to their left,
+// so any capacity the table covers works.
+KnapsackSolution knapsackTraceback(Item items[], int n, const uint64_t *take,
+                                   int words, int capacity, int value) {
+  Item *selected_items = (Item *)malloc(n * sizeof(Item));
+  int count = 0;
+  int w = capacity;
+
+  for (int i = n - 1; i >= 0; i--) {
+    const uint64_t *row = take + (size_t)i * words;
+    if (row[w / WORD_BITS] >> (w % WORD_BITS) & 1) {
+      // This item is included, continue from the capacity it left
+      selected_items[count++] = items[i];
+      w -= items[i].weight;
+    }
+  }
+
+  return (KnapsackSolution){.selected = selected_items,
+                            .n = count,
+                            .value = value,
+                            .remaining_capacity = w};
+}
+
 KnapsackSolution knapsack(Item items[], int n, int capacity) {
-  if (n == 0 || capacity == 0) {
+  if (n <= 0 || capacity <= 0) {
     return (KnapsackSolution){
         .selected = NULL, .n = 0, .value = 0, .remaining_capacity = capacity};
   }
@@ -47,306 +202,3040 @@ KnapsackSolution knapsack(Item items[], int n, int capacity) {
                                   capacity - selected_item->weight};
   }
 
-  // Build the table
-  int dp[n + 1][capacity + 1];
-  for (int i = 0; i <= n; i++) {
-    for (int w = 0; w <= capacity; w++) {
-      if (i == 0 || w == 0) {
-        dp[i][w] = 0;
-      } else if (items[i - 1].weight <= w) {
-        // Consider the item or do not consider it, take the maximum
-        dp[i][w] =
-            (items[i - 1].value + dp[i - 1][w - items[i - 1].weight] >
-             dp[i - 1][w])
-                ? (items[i - 1].value + dp[i - 1][w - items[i - 1].weight])
-                : (dp[i - 1][w]);
-      } else {
-        // Do not take the item
-        dp[i][w] = dp[i - 1][w];
+  // One rolling row of the table, plus one bit per cell recording whether
+  // item i was taken at capacity w
+  int *dp = (int *)calloc(capacity + 1, sizeof(int));
+  int words = bitsetWords(capacity + 1);
+  uint64_t *take = (uint64_t *)calloc((size_t)n * words, sizeof(uint64_t));
+  if (dp == NULL || take == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  RowKernel kernel = selectRowKernel();
+  for (int i = 0; i < n; i++) {
+    kernel(dp, dp, take + (size_t)i * words, 0, capacity + 1,
+           items[i].weight, items[i].value);
+  }
+
+  // The last cell of the row will have the answer
+  KnapsackSolution solution =
+      knapsackTraceback(items, n, take, words, capacity, dp[capacity]);
+
+  free(dp);
+  free(take);
+  return solution;
+}
+
+// dp[w] = the best value of items[0..n) within capacity w, for every w up to
+// capacity, with one rolling row
+void knapsackRow(Item items[], int n, int capacity, int *dp) {
+  memset(dp, 0, (capacity + 1) * sizeof(int));
+  RowKernel kernel = selectRowKernel();
+  for (int i = 0; i < n; i++) {
+    kernel(dp, dp, NULL, 0, capacity + 1, items[i].weight, items[i].value);
+  }
+}
+
+// The best value alone needs just the rolling row, O(capacity) memory
+int knapsackValue(Item items[], int n, int capacity) {
+  if (capacity <= 0) {
+    return 0;
+  }
+
+  int *dp = (int *)malloc((capacity + 1) * sizeof(int));
+  if (dp == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  knapsackRow(items, n, capacity, dp);
+  int result = dp[capacity];
+  free(dp);
+  return result;
+}
+
+// Cells of a row handed out at a time by the parallel engine, 16KB of each
+// row. A multiple of WORD_BITS keeps every word of the take bits with one
+// thread.
+#define CHUNK_CELLS 4096
+
+typedef struct {
+  Item *items;
+  int n;
+  int from;
+  int to;
+  int *rows[2];
+  uint64_t *take;
+  int words;
+  RowKernel kernel;
+  pthread_barrier_t *barrier;
+} KnapsackTask;
+
+// Computes cells [from, to) of every row. Each row reads only the previous
+// one, so the threads just wait for each other at the end of the row.
+void *knapsackWorker(void *arg) {
+  KnapsackTask *task = (KnapsackTask *)arg;
+  const int *prev = task->rows[0];
+  int *next = task->rows[1];
+
+  for (int i = 0; i < task->n; i++) {
+    uint64_t *row =
+        task->take != NULL ? task->take + (size_t)i * task->words : NULL;
+    // The same kernel as knapsack(), so ties go the same way
+    task->kernel(prev, next, row, task->from, task->to, task->items[i].weight,
+           task->items[i].value);
+
+    pthread_barrier_wait(task->barrier);
+    const int *t = prev;
+    prev = next;
+    next = (int *)t;
+  }
+  return NULL;
+}
+
+// Runs the table over threads threads with two rows, filling take when it
+// isn't NULL and copying the last row to last when it isn't NULL, and
+// returns the best value
+int knapsackRows(Item items[], int n, int capacity, int threads,
+                 uint64_t *take, int *last) {
+  int chunks = (capacity + CHUNK_CELLS) / CHUNK_CELLS;
+  if (threads > chunks) {
+    threads = chunks;
+  }
+
+  int *rows[2] = {(int *)calloc(capacity + 1, sizeof(int)),
+                  (int *)malloc((capacity + 1) * sizeof(int))};
+  KnapsackTask *tasks = (KnapsackTask *)malloc(threads * sizeof(KnapsackTask));
+  pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if (rows[0] == NULL || rows[1] == NULL || tasks == NULL || ids == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, threads);
+
+  // Contiguous runs of whole chunks, as even as they divide
+  for (int t = 0; t < threads; t++) {
+    int from = (int)((long)chunks * t / threads) * CHUNK_CELLS;
+    int to = (int)((long)chunks * (t + 1) / threads) * CHUNK_CELLS;
+    tasks[t] = (KnapsackTask){.items = items,
+                              .n = n,
+                              .from = from,
+                              .to = to < capacity + 1 ? to : capacity + 1,
+                              .rows = {rows[0], rows[1]},
+                              .take = take,
+                              .words = bitsetWords(capacity + 1),
+                              .kernel = selectRowKernel(),
+                              .barrier = &barrier};
+  }
+
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&ids[t], NULL, knapsackWorker, &tasks[t]) != 0) {
+      fprintf(stderr, "Thread creation failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  knapsackWorker(&tasks[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  // Row i was written to rows[(i + 1) % 2]
+  int result = rows[n % 2][capacity];
+  if (last != NULL) {
+    memcpy(last, rows[n % 2], (capacity + 1) * sizeof(int));
+  }
+
+  pthread_barrier_destroy(&barrier);
+  free(rows[0]);
+  free(rows[1]);
+  free(tasks);
+  free(ids);
+  return result;
+}
+
+int defaultThreads() { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
+
+// knapsack() with each row split across threads, with identical results.
+// threads <= 0 uses every online core.
+KnapsackSolution knapsackParallel(Item items[], int n, int capacity,
+                                  int threads) {
+  if (threads <= 0) {
+    threads = defaultThreads();
+  }
+  if (threads == 1 || n <= 1 || capacity <= 0) {
+    return knapsack(items, n, capacity);
+  }
+
+  int words = bitsetWords(capacity + 1);
+  uint64_t *take = (uint64_t *)calloc((size_t)n * words, sizeof(uint64_t));
+  if (take == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int value = knapsackRows(items, n, capacity, threads, take, NULL);
+  KnapsackSolution solution =
+      knapsackTraceback(items, n, take, words, capacity, value);
+
+  free(take);
+  return solution;
+}
+
+// knapsackValue() with each row split across threads
+int knapsackValueParallel(Item items[], int n, int capacity, int threads) {
+  if (threads <= 0) {
+    threads = defaultThreads();
+  }
+  if (threads == 1 || capacity <= 0) {
+    return knapsackValue(items, n, capacity);
+  }
+  return knapsackRows(items, n, capacity, threads, NULL, NULL);
+}
+
+// The best value within every capacity up to capacity, as a row the caller
+// frees
+int *knapsackValues(Item items[], int n, int capacity, int threads) {
+  if (capacity < 0) {
+    capacity = 0;
+  }
+  if (threads <= 0) {
+    threads = defaultThreads();
+  }
+
+  int *dp = (int *)malloc((capacity + 1) * sizeof(int));
+  if (dp == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (threads == 1) {
+    knapsackRow(items, n, capacity, dp);
+  } else {
+    knapsackRows(items, n, capacity, threads, NULL, dp);
+  }
+  return dp;
+}
+
+// Solves the same items within each of count capacities from one table,
+// built for the largest, instead of one table per capacity. Returns count
+// solutions the caller frees.
+KnapsackSolution *knapsackBatch(Item items[], int n, const int capacities[],
+                                int count, int threads) {
+  KnapsackSolution *solutions =
+      (KnapsackSolution *)malloc((count > 0 ? count : 1) *
+                                 sizeof(KnapsackSolution));
+  int capacity = 0;
+  for (int c = 0; c < count; c++) {
+    if (capacities[c] > capacity) {
+      capacity = capacities[c];
+    }
+  }
+  if (threads <= 0) {
+    threads = defaultThreads();
+  }
+
+  int words = bitsetWords(capacity + 1);
+  uint64_t *take = NULL;
+  int *last = (int *)malloc((capacity + 1) * sizeof(int));
+  if (n > 0 && capacity > 0) {
+    take = (uint64_t *)calloc((size_t)n * words, sizeof(uint64_t));
+    if (take == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    knapsackRows(items, n, capacity, threads, take, last);
+  }
+
+  for (int c = 0; c < count; c++) {
+    if (take == NULL || capacities[c] <= 0) {
+      solutions[c] = (KnapsackSolution){.selected = NULL,
+                                        .n = 0,
+                                        .value = 0,
+                                        .remaining_capacity = capacities[c]};
+    } else {
+      solutions[c] = knapsackTraceback(items, n, take, words, capacities[c],
+                                       last[capacities[c]]);
+    }
+  }
+
+  free(take);
+  free(last);
+  return solutions;
+}
+
+// Whether no selection of the items can overflow an int. Every cell of the
+// table is the value of some selection, so checking the sum of the
+// positive values once keeps the row kernels free of checks.
+bool knapsackValuesFit(const Item items[], int n) {
+  int64_t total = 0;
+  for (int i = 0; i < n; i++) {
+    if (items[i].value > 0) {
+      total += items[i].value;
+    }
+  }
+  return total <= INT_MAX;
+}
+
+// The same for int64_t
+bool knapsackValuesFit64(const Item64 items[], int n) {
+  int64_t total = 0;
+  for (int i = 0; i < n; i++) {
+    if (items[i].value > 0 &&
+        __builtin_add_overflow(total, items[i].value, &total)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// RowKernel over int64_t cells. Weights past the row never fit, so they
+// arrive already narrowed to int.
+typedef void (*RowKernel64)(const int64_t *prev, int64_t *next,
+                            uint64_t *take, int from, int to, int weight,
+                            int64_t value);
+
+void rowScalar64(const int64_t *prev, int64_t *next, uint64_t *take,
+                 int from, int to, int weight, int64_t value) {
+  int w = to - 1;
+  for (; w >= from && w >= weight; w--) {
+    if (prev[w - weight] + value > prev[w]) {
+      next[w] = prev[w - weight] + value;
+      if (take != NULL) {
+        take[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
       }
+    } else {
+      next[w] = prev[w];
+    }
+  }
+  if (next != prev) {
+    for (; w >= from; w--) {
+      next[w] = prev[w];
+    }
+  }
+}
+
+#if defined(__x86_64__)
+// Four cells at a time. AVX2 has no 64-bit max, so the compare mask
+// blends the two candidates and its four bits go into take.
+__attribute__((target("avx2"))) void
+rowAvx264(const int64_t *prev, int64_t *next, uint64_t *take, int from,
+          int to, int weight, int64_t value) {
+  int low = from > weight ? from : weight;
+  int top = to & ~3;
+  int bottom = (low + 3) & ~3;
+  if (top <= bottom) {
+    rowScalar64(prev, next, take, from, to, weight, value);
+    return;
+  }
+
+  rowScalar64(prev, next, take, top, to, weight, value);
+
+  const __m256i add = _mm256_set1_epi64x(value);
+  uint8_t *bytes = (uint8_t *)take;
+  for (int w = top - 4; w >= bottom; w -= 4) {
+    __m256i old = _mm256_loadu_si256((const __m256i *)(prev + w));
+    __m256i with = _mm256_add_epi64(
+        _mm256_loadu_si256((const __m256i *)(prev + w - weight)), add);
+    __m256i taken = _mm256_cmpgt_epi64(with, old);
+    if (take != NULL) {
+      bytes[w / 8] |= _mm256_movemask_pd(_mm256_castsi256_pd(taken))
+                      << (w % 8);
     }
+    _mm256_storeu_si256((__m256i *)(next + w),
+                        _mm256_blendv_epi8(old, with, taken));
   }
 
-  // The last cell of the table will have the answer
-  int result = dp[n][capacity];
+  rowScalar64(prev, next, take, from, bottom, weight, value);
+}
+#endif
+
+RowKernel64 selectRowKernel64() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return rowAvx264;
+  }
+#endif
+  return rowScalar64;
+}
+
+// Runs the rolling row of int64_t cells over the items that can fit,
+// filling take when it isn't NULL
+void knapsackRow64(const Item64 items[], int n, int capacity, int64_t *dp,
+                   uint64_t *take, int words) {
+  memset(dp, 0, (capacity + 1) * sizeof(int64_t));
+  RowKernel64 kernel = selectRowKernel64();
+  for (int i = 0; i < n; i++) {
+    if (items[i].weight >= 0 && items[i].weight <= capacity) {
+      kernel(dp, dp, take != NULL ? take + (size_t)i * words : NULL, 0,
+             capacity + 1, (int)items[i].weight, items[i].value);
+    }
+  }
+}
+
+// knapsack() over int64_t values, with the same one bit per cell. Values
+// whose sum could overflow are reported through overflow up front rather
+// than checked cell by cell.
+KnapsackSolution64 knapsack64(Item64 items[], int n, int capacity) {
+  if (!knapsackValuesFit64(items, n)) {
+    return (KnapsackSolution64){.overflow = true};
+  }
+  if (n <= 0 || capacity <= 0) {
+    return (KnapsackSolution64){
+        .selected = NULL, .n = 0, .value = 0, .remaining_capacity = capacity};
+  }
+
+  int64_t *dp = (int64_t *)malloc((capacity + 1) * sizeof(int64_t));
+  int words = bitsetWords(capacity + 1);
+  uint64_t *take = (uint64_t *)calloc((size_t)n * words, sizeof(uint64_t));
+  Item64 *selected_items = (Item64 *)malloc(n * sizeof(Item64));
+  if (dp == NULL || take == NULL || selected_items == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  knapsackRow64(items, n, capacity, dp, take, words);
 
-  Item *selected_items = (Item *)malloc(n * sizeof(Item));
   int count = 0;
   int w = capacity;
+  for (int i = n - 1; i >= 0; i--) {
+    const uint64_t *row = take + (size_t)i * words;
+    if (row[w / WORD_BITS] >> (w % WORD_BITS) & 1) {
+      selected_items[count++] = items[i];
+      w -= (int)items[i].weight;
+    }
+  }
+
+  KnapsackSolution64 solution = {.selected = selected_items,
+                                 .n = count,
+                                 .value = dp[capacity],
+                                 .remaining_capacity = w};
+  free(dp);
+  free(take);
+  return solution;
+}
+
+// knapsackValue() over int64_t values. Returns -1 when the values could
+// overflow.
+int64_t knapsackValue64(Item64 items[], int n, int capacity) {
+  if (!knapsackValuesFit64(items, n)) {
+    return -1;
+  }
+  if (capacity <= 0) {
+    return 0;
+  }
+
+  int64_t *dp = (int64_t *)malloc((capacity + 1) * sizeof(int64_t));
+  if (dp == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  knapsackRow64(items, n, capacity, dp, NULL, 0);
+  int64_t result = dp[capacity];
+  free(dp);
+  return result;
+}
+
+// Adds an optimal selection of items[0..n) within capacity to selected.
+// The best values of each half of the items are computed for every
+// capacity, and the capacity is split where the two add up to the
+// optimum, so each half can be solved on its own share. front and back
+// are only needed until the split is found and are reused below.
+void hirschberg(Item items[], int n, int capacity, int *front, int *back,
+                Item *selected, int *count) {
+  if (n == 1) {
+    if (items[0].weight <= capacity && items[0].value > 0) {
+      selected[(*count)++] = items[0];
+    }
+    return;
+  }
+
+  int half = n / 2;
+  knapsackRow(items, half, capacity, front);
+  knapsackRow(items + half, n - half, capacity, back);
 
-  for (int i = n; i > 0 && result > 0; i--) {
-    if (result != dp[i - 1][w]) {
-      // This item is included.
-      selected_items[count++] = items[i - 1];
-      // We remove this item's weight from the total weight
-      w -= items[i - 1].weight;
-      // Subtract the item's value from the result to continue tracing back
-      result -= items[i - 1].value;
+  int split = 0;
+  for (int w = 1; w <= capacity; w++) {
+    if (front[w] + back[capacity - w] >
+        front[split] + back[capacity - split]) {
+      split = w;
     }
   }
 
+  hirschberg(items, half, split, front, back, selected, count);
+  hirschberg(items + half, n - half, capacity - split, front, back, selected,
+             count);
+}
+
+// knapsack() in O(n + capacity) memory instead of a bit per cell, for about
+// twice the time
+KnapsackSolution knapsackHirschberg(Item items[], int n, int capacity) {
+  if (n <= 0 || capacity < 0) {
+    return (KnapsackSolution){
+        .selected = NULL, .n = 0, .value = 0, .remaining_capacity = capacity};
+  }
+
+  int *front = (int *)malloc((capacity + 1) * sizeof(int));
+  int *back = (int *)malloc((capacity + 1) * sizeof(int));
+  Item *selected_items = (Item *)malloc(n * sizeof(Item));
+  if (front == NULL || back == NULL || selected_items == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int count = 0;
+  hirschberg(items, n, capacity, front, back, selected_items, &count);
+
+  int value = 0;
+  int w = capacity;
+  for (int i = 0; i < count; i++) {
+    value += selected_items[i].value;
+    w -= selected_items[i].weight;
+  }
+
+  free(front);
+  free(back);
+
   return (KnapsackSolution){.selected = selected_items,
                             .n = count,
-                            .value = dp[n][capacity],
+                            .value = value,
                             .remaining_capacity = w};
 }
 
-void printKnapsackSolution(KnapsackSolution solution) {
-  printf("Maximum value in knapsack = %d\n", solution.value);
-  printf("Remaining capacity = %d\n", solution.remaining_capacity);
-  printf("Number of items included = %d\n", solution.n);
-  printf("Items included in the knapsack:\n");
-  for (int i = 0; i < solution.n; i++) {
-    printf("Item %d: Weight = %d, Value = %d\n", i + 1,
-           solution.selected[i].weight, solution.selected[i].value);
-  }
+// Orders items by value density, best first. The cross products need 64
+// bits but stay exact, and a zero weight with a positive value sorts first.
+int compareDensity(const void *a, const void *b) {
+  const Item *x = (const Item *)a;
+  const Item *y = (const Item *)b;
+  long long left = (long long)x->value * y->weight;
+  long long right = (long long)y->value * x->weight;
+  return (left < right) - (left > right);
 }
 
-SubsetSumSolution subsetSum(int set[], int n, int capacity) {
-  Item items[n];
+// weights[i] and values[i] = the totals of the first i items
+void prefixSums(const Item items[], int n, long long *weights,
+                long long *values) {
+  weights[0] = 0;
+  values[0] = 0;
   for (int i = 0; i < n; i++) {
-    items[i].weight = set[i];
-    items[i].value = set[i];
+    weights[i + 1] = weights[i] + items[i].weight;
+    values[i + 1] = values[i] + items[i].value;
+  }
+}
+
+// Depth-first search over items sorted by density, taking each item before
+// leaving it. weights[i] and values[i] are prefix sums over the first i
+// items, so the fractional bound of a node is a binary search away.
+typedef struct {
+  Item *items;
+  int n;
+  long long *weights;
+  long long *values;
+  bool *current;
+  bool *best_take;
+  long long best;
+  bool found;
+} BranchAndBound;
+
+// Value of the fractional knapsack over items i.. within capacity: whole
+// items while they fit, then the fitting share of the next one
+long long fractionalBound(BranchAndBound *bb, int i, long long capacity) {
+  int low = i;
+  int high = bb->n;
+  long long limit = bb->weights[i] + capacity;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (bb->weights[mid] <= limit) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
   }
 
-  KnapsackSolution knapsack_solution = knapsack(items, n, capacity);
+  long long bound = bb->values[low] - bb->values[i];
+  if (low < bb->n) {
+    long long rest = limit - bb->weights[low];
+    bound += rest * bb->items[low].value / bb->items[low].weight;
+  }
+  return bound;
+}
 
-  int *selected = (int *)malloc(knapsack_solution.n * sizeof(int));
-  for (int i = 0; i < knapsack_solution.n; i++) {
-    selected[i] = knapsack_solution.selected[i].weight;
+// A node whose take branch is being searched, so its leave branch is next
+typedef struct {
+  int i;
+  long long capacity;
+  long long value;
+} BranchFrame;
+
+// The search runs as many items deep as the core has, so it keeps its own
+// stack of nodes instead of recursing. Leaving an item is the last thing a
+// node does, so it continues in place and only taking an item pushes one.
+void branch(BranchAndBound *bb, long long capacity) {
+  BranchFrame *stack =
+      (BranchFrame *)malloc((bb->n + 1) * sizeof(BranchFrame));
+  if (stack == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
   }
+  int depth = 0;
+  int i = 0;
+  long long value = 0;
+
+  while (true) {
+    if (value > bb->best) {
+      bb->best = value;
+      bb->found = true;
+      memcpy(bb->best_take, bb->current, bb->n * sizeof(bool));
+    }
 
-  free(knapsack_solution.selected);
+    if (i < bb->n && value + fractionalBound(bb, i, capacity) > bb->best) {
+      if (bb->items[i].weight <= capacity) {
+        stack[depth++] = (BranchFrame){i, capacity, value};
+        bb->current[i] = true;
+        capacity -= bb->items[i].weight;
+        value += bb->items[i].value;
+      }
+      i++;
+    } else if (depth > 0) {
+      BranchFrame frame = stack[--depth];
+      bb->current[frame.i] = false;
+      i = frame.i + 1;
+      capacity = frame.capacity;
+      value = frame.value;
+    } else {
+      break;
+    }
+  }
 
-  return (SubsetSumSolution){.selected = selected,
-                             .n = knapsack_solution.n,
-                             .value = knapsack_solution.value,
-                             .remaining_capacity =
-                                 knapsack_solution.remaining_capacity};
+  free(stack);
 }
 
-void printSubsetSumSolution(SubsetSumSolution solution) {
-  printf("Maximum value in subset sum = %d\n", solution.value);
-  printf("Remaining capacity = %d\n", solution.remaining_capacity);
-  printf("Number of items included = %d\n", solution.n);
-  printf("Items included in the subset sum:\n");
-  for (int i = 0; i < solution.n; i++) {
-    printf("Item %d: Weight = %d\n", i + 1, solution.selected[i]);
+// Exact knapsack without a table, so the capacity can be as large as an
+// int holds. Items are sorted by value density and searched depth first,
+// pruned by the fractional knapsack bound, starting from the greedy
+// solution.
+//
+// With reduce, items whose best completion when flipped against the
+// fractional solution can't beat the greedy value are fixed first (Dembo
+// and Hammer), so the search only runs over the core around the critical
+// item, the first one the greedy fill can't take whole.
+KnapsackSolution knapsackBranchAndBound(Item items[], int n, int capacity,
+                                        bool reduce) {
+  // Items that can never be part of a better solution are left out
+  Item *sorted = (Item *)malloc((n > 0 ? n : 1) * sizeof(Item));
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (items[i].value > 0 && items[i].weight >= 0 &&
+        items[i].weight <= capacity) {
+      sorted[m++] = items[i];
+    }
+  }
+  qsort(sorted, m, sizeof(Item), compareDensity);
+
+  long long *weights = (long long *)malloc((m + 1) * sizeof(long long));
+  long long *values = (long long *)malloc((m + 1) * sizeof(long long));
+  prefixSums(sorted, m, weights, values);
+
+  // The greedy solution, skipping what doesn't fit, is the first incumbent
+  bool *greedy = (bool *)calloc(m + 1, sizeof(bool));
+  long long lower = 0;
+  long long left = capacity;
+  for (int i = 0; i < m; i++) {
+    if (sorted[i].weight <= left) {
+      greedy[i] = true;
+      left -= sorted[i].weight;
+      lower += sorted[i].value;
+    }
   }
-}
 
-#ifdef TEST
-bool testEqual(int actual, int expected) { return actual == expected; }
+  // fixed[i] is 1 or 0 for a fixed item and -1 for a free one
+  signed char *fixed = (signed char *)malloc(m + 1);
+  memset(fixed, -1, m + 1);
 
-int compareItems(const void *a, const void *b) {
-  Item *itemA = (Item *)a;
-  Item *itemB = (Item *)b;
-  if (itemA->weight != itemB->weight) {
-    return itemA->weight - itemB->weight;
+  int critical = 0;
+  while (critical < m && weights[critical + 1] <= capacity) {
+    critical++;
   }
-  return itemA->value - itemB->value;
-}
 
-int compareInts(const void *a, const void *b) {
-  return (*(int *)a - *(int *)b);
-}
+  if (reduce && critical < m) {
+    // Bounds scaled by the critical item's weight, so everything is an
+    // integer. The fractional optimum is U = V + (C - W) * v / w.
+    __int128 v = sorted[critical].value;
+    __int128 w = sorted[critical].weight;
+    __int128 scaled = (__int128)values[critical] * w +
+                      (__int128)(capacity - weights[critical]) * v;
+    __int128 target = (__int128)(lower + 1) * w;
+
+    for (int j = 0; j < m; j++) {
+      // Leaving out an item before the critical one frees its weight for
+      // items no denser than v / w, and taking one after it costs at least
+      // that density in the items it pushes out
+      __int128 change = sorted[j].value * w - sorted[j].weight * v;
+      __int128 flipped = j < critical ? scaled - change : scaled + change;
+      if (j != critical && flipped < target) {
+        fixed[j] = j < critical;
+      }
+    }
+  }
 
-bool testItemArrayEqual(Item *actual, Item *expected, int size) {
-  qsort(actual, size, sizeof(Item), compareItems);
-  qsort(expected, size, sizeof(Item), compareItems);
+  // Search the free items with the capacity the fixed ones leave
+  Item *core = (Item *)malloc((m > 0 ? m : 1) * sizeof(Item));
+  int *core_index = (int *)malloc((m > 0 ? m : 1) * sizeof(int));
+  int core_n = 0;
+  long long core_capacity = capacity;
+  long long fixed_value = 0;
+  for (int i = 0; i < m; i++) {
+    if (fixed[i] == 1) {
+      core_capacity -= sorted[i].weight;
+      fixed_value += sorted[i].value;
+    } else if (fixed[i] == -1) {
+      core_index[core_n] = i;
+      core[core_n++] = sorted[i];
+    }
+  }
 
-  for (int i = 0; i < size; i++) {
-    if (actual[i].weight != expected[i].weight ||
-        actual[i].value != expected[i].value) {
-      return false;
+  long long *core_weights =
+      (long long *)malloc((core_n + 1) * sizeof(long long));
+  long long *core_values =
+      (long long *)malloc((core_n + 1) * sizeof(long long));
+  prefixSums(core, core_n, core_weights, core_values);
+
+  BranchAndBound bb = {.items = core,
+                       .n = core_n,
+                       .weights = core_weights,
+                       .values = core_values,
+                       .current = (bool *)calloc(core_n + 1, sizeof(bool)),
+                       .best_take = (bool *)calloc(core_n + 1, sizeof(bool)),
+                       .best = lower - fixed_value,
+                       .found = false};
+  branch(&bb, core_capacity);
+
+  // Either the search beat the greedy solution, or the greedy one stands
+  Item *selected_items = (Item *)malloc((m > 0 ? m : 1) * sizeof(Item));
+  int count = 0;
+  long long value = 0;
+  long long w = capacity;
+  if (bb.found) {
+    memset(greedy, 0, m + 1);
+    for (int i = 0; i < m; i++) {
+      greedy[i] = fixed[i] == 1;
+    }
+    for (int i = 0; i < core_n; i++) {
+      greedy[core_index[i]] = bb.best_take[i];
+    }
+  }
+  for (int i = 0; i < m; i++) {
+    if (greedy[i]) {
+      selected_items[count++] = sorted[i];
+      value += sorted[i].value;
+      w -= sorted[i].weight;
     }
   }
 
-  return true;
+  free(sorted);
+  free(weights);
+  free(values);
+  free(greedy);
+  free(fixed);
+  free(core);
+  free(core_index);
+  free(core_weights);
+  free(core_values);
+  free(bb.current);
+  free(bb.best_take);
+
+  return (KnapsackSolution){.selected = selected_items,
+                            .n = count,
+                            .value = (int)value,
+                            .remaining_capacity = (int)w};
+}
+
+// Bounded knapsack through 0/1 items. k copies of an item are split into
+// pieces of 1, 2, 4, ... copies and the remainder, whose sums make every
+// count from 0 to k, so an item costs O(log k) rows instead of k. Counts
+// past capacity / weight can never be used and are dropped first.
+BoundedSolution knapsackBounded(BoundedItem items[], int n, int capacity) {
+  // The best value is at most every usable copy together
+  int64_t total = 0;
+  for (int i = 0; i < n; i++) {
+    if (items[i].value > 0 && items[i].count > 0 && items[i].weight >= 0 &&
+        items[i].weight <= capacity) {
+      int64_t usable = items[i].count;
+      if (items[i].weight > 0 && usable > capacity / items[i].weight) {
+        usable = capacity / items[i].weight;
+      }
+      total += usable * items[i].value;
+      if (total > INT_MAX) {
+        return (BoundedSolution){.overflow = true};
+      }
+    }
+  }
+
+  int *counts = (int *)calloc(n > 0 ? n : 1, sizeof(int));
+  if (n <= 0 || capacity <= 0) {
+    return (BoundedSolution){.counts = counts,
+                             .n = n > 0 ? n : 0,
+                             .value = 0,
+                             .remaining_capacity = capacity};
+  }
+
+  // A count fits in 31 bits, so it splits into at most 31 pieces
+  size_t size = (size_t)n * 31;
+  Item *pieces = (Item *)malloc(size * sizeof(Item));
+  int *owner = (int *)malloc(size * sizeof(int));
+  int *copies = (int *)malloc(size * sizeof(int));
+  if (counts == NULL || pieces == NULL || owner == NULL || copies == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (items[i].value <= 0 || items[i].weight < 0 ||
+        items[i].weight > capacity) {
+      continue;
+    }
+    int left = items[i].count;
+    if (items[i].weight > 0 && left > capacity / items[i].weight) {
+      left = capacity / items[i].weight;
+    }
+    // k is 64 bits since it passes 2^30 when the count is INT_MAX
+    for (int64_t k = 1; left > 0; k *= 2) {
+      int take = k < left ? (int)k : left;
+      pieces[m] = (Item){.weight = take * items[i].weight,
+                         .value = take * items[i].value};
+      owner[m] = i;
+      copies[m++] = take;
+      left -= take;
+    }
+  }
+
+  int words = bitsetWords(capacity + 1);
+  uint64_t *take = (uint64_t *)calloc((size_t)(m > 0 ? m : 1) * words,
+                                      sizeof(uint64_t));
+  if (take == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int value = knapsackRows(pieces, m, capacity, 1, take, NULL);
+
+  int w = capacity;
+  for (int j = m - 1; j >= 0; j--) {
+    const uint64_t *row = take + (size_t)j * words;
+    if (row[w / WORD_BITS] >> (w % WORD_BITS) & 1) {
+      counts[owner[j]] += copies[j];
+      w -= pieces[j].weight;
+    }
+  }
+
+  free(pieces);
+  free(owner);
+  free(copies);
+  free(take);
+
+  return (BoundedSolution){
+      .counts = counts, .n = n, .value = value, .remaining_capacity = w};
+}
+
+// Unbounded knapsack with one row. Walking the row up instead of down lets
+// dp[w - weight] already include the item, so it can be taken any number
+// of times. last[w] is the item that last improved dp[w], which is a
+// valid first step back from w since dp[w - weight] can only grow after
+// it. Items with weight 0 would make the value infinite and are skipped.
+BoundedSolution knapsackUnbounded(Item items[], int n, int capacity) {
+  // No selection, however it mixes items, beats filling the whole
+  // capacity at the best density, so the best value is at most the
+  // largest capacity * value / weight
+  for (int i = 0; i < n; i++) {
+    if (items[i].weight > 0 && items[i].value > 0 &&
+        items[i].weight <= capacity &&
+        (int64_t)capacity * items[i].value / items[i].weight > INT_MAX) {
+      return (BoundedSolution){.overflow = true};
+    }
+  }
+
+  int *counts = (int *)calloc(n > 0 ? n : 1, sizeof(int));
+  if (n <= 0 || capacity <= 0) {
+    return (BoundedSolution){.counts = counts,
+                             .n = n > 0 ? n : 0,
+                             .value = 0,
+                             .remaining_capacity = capacity};
+  }
+
+  int *dp = (int *)calloc(capacity + 1, sizeof(int));
+  int *last = (int *)malloc((capacity + 1) * sizeof(int));
+  if (counts == NULL || dp == NULL || last == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(last, -1, (capacity + 1) * sizeof(int));
+
+  for (int i = 0; i < n; i++) {
+    int weight = items[i].weight;
+    int value = items[i].value;
+    if (weight <= 0 || value <= 0) {
+      continue;
+    }
+    for (int w = weight; w <= capacity; w++) {
+      if (dp[w - weight] + value > dp[w]) {
+        dp[w] = dp[w - weight] + value;
+        last[w] = i;
+      }
+    }
+  }
+
+  int w = capacity;
+  while (last[w] >= 0) {
+    counts[last[w]]++;
+    w -= items[last[w]].weight;
+  }
+
+  BoundedSolution solution = {.counts = counts,
+                              .n = n,
+                              .value = dp[capacity],
+                              .remaining_capacity = w};
+  free(dp);
+  free(last);
+  return solution;
+}
+
+void printKnapsackSolution(KnapsackSolution solution) {
+  printf("Maximum value in knapsack = %d\n", solution.value);
+  printf("Remaining capacity = %d\n", solution.remaining_capacity);
+  printf("Number of items included = %d\n", solution.n);
+  printf("Items included in the knapsack:\n");
+  for (int i = 0; i < solution.n; i++) {
+    printf("Item %d: Weight = %d, Value = %d\n", i + 1,
+           solution.selected[i].weight, solution.selected[i].value);
+  }
+}
+
+// items are the kinds of item the counts refer to
+void printBoundedSolution(BoundedSolution solution, const Item items[]) {
+  int total = 0;
+  for (int i = 0; i < solution.n; i++) {
+    total += solution.counts[i];
+  }
+
+  printf("Maximum value in knapsack = %d\n", solution.value);
+  printf("Remaining capacity = %d\n", solution.remaining_capacity);
+  printf("Number of items included = %d\n", total);
+  printf("Items included in the knapsack:\n");
+  for (int i = 0, k = 0; i < solution.n; i++) {
+    if (solution.counts[i] > 0) {
+      printf("Item %d: Weight = %d, Value = %d, Count = %d\n", ++k,
+             items[i].weight, items[i].value, solution.counts[i]);
+    }
+  }
+}
+
+void printKnapsackSolution64(KnapsackSolution64 solution) {
+  printf("Maximum value in knapsack = %" PRId64 "\n", solution.value);
+  printf("Remaining capacity = %" PRId64 "\n", solution.remaining_capacity);
+  printf("Number of items included = %d\n", solution.n);
+  printf("Items included in the knapsack:\n");
+  for (int i = 0; i < solution.n; i++) {
+    printf("Item %d: Weight = %" PRId64 ", Value = %" PRId64 "\n", i + 1,
+           solution.selected[i].weight, solution.selected[i].value);
+  }
+}
+
+// Subset sum as reachability: bit s of reach is set when some subset sums
+// to s, and adding an element w is reach |= reach << w. A kernel does that
+// shift-or in place for element index, and when first isn't NULL records
+// index as first[s] for every sum it reaches for the first time.
+typedef void (*ShiftOrKernel)(uint64_t *reach, int words, int shift,
+                              int index, int *first);
+
+void recordFresh(uint64_t fresh, int word, int index, int *first) {
+  while (fresh != 0) {
+    first[word * WORD_BITS + __builtin_ctzll(fresh)] = index;
+    fresh &= fresh - 1;
+  }
+}
+
+// Words top down to the shift's word offset, from high to low so that
+// every source word is read before it is overwritten
+void shiftOrWords(uint64_t *reach, int top, int shift, int index,
+                  int *first) {
+  int offset = shift / WORD_BITS;
+  int bits = shift % WORD_BITS;
+  for (int j = top; j >= offset; j--) {
+    uint64_t shifted = reach[j - offset] << bits;
+    if (bits > 0 && j > offset) {
+      shifted |= reach[j - offset - 1] >> (WORD_BITS - bits);
+    }
+    if (first != NULL) {
+      recordFresh(shifted & ~reach[j], j, index, first);
+    }
+    reach[j] |= shifted;
+  }
+}
+
+void shiftOrScalar(uint64_t *reach, int words, int shift, int index,
+                   int *first) {
+  shiftOrWords(reach, words - 1, shift, index, first);
+}
+
+#if defined(__x86_64__)
+// Four words at a time. A block only reads words at or below its own, and
+// loads them all before its store, so the in-place update stays correct.
+__attribute__((target("avx2"))) void
+shiftOrAvx2(uint64_t *reach, int words, int shift, int index, int *first) {
+  int offset = shift / WORD_BITS;
+  int bits = shift % WORD_BITS;
+  // Counts of 64 shift everything out, which covers bits == 0
+  __m128i left = _mm_cvtsi32_si128(bits);
+  __m128i right = _mm_cvtsi32_si128(WORD_BITS - bits);
+
+  int j = words - 1;
+  for (; j - 3 > offset; j -= 4) {
+    __m256i old = _mm256_loadu_si256((const __m256i *)(reach + j - 3));
+    __m256i source =
+        _mm256_loadu_si256((const __m256i *)(reach + j - 3 - offset));
+    __m256i below =
+        _mm256_loadu_si256((const __m256i *)(reach + j - 4 - offset));
+    __m256i shifted = _mm256_or_si256(_mm256_sll_epi64(source, left),
+                                      _mm256_srl_epi64(below, right));
+
+    __m256i fresh = _mm256_andnot_si256(old, shifted);
+    if (first != NULL && !_mm256_testz_si256(fresh, fresh)) {
+      uint64_t lanes[4];
+      _mm256_storeu_si256((__m256i *)lanes, fresh);
+      for (int k = 0; k < 4; k++) {
+        recordFresh(lanes[k], j - 3 + k, index, first);
+      }
+    }
+    _mm256_storeu_si256((__m256i *)(reach + j - 3),
+                        _mm256_or_si256(old, shifted));
+  }
+
+  shiftOrWords(reach, j, shift, index, first);
+}
+#endif
+
+ShiftOrKernel shiftOrKernel() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return shiftOrAvx2;
+  }
+#endif
+  return shiftOrScalar;
+}
+
+// The largest subset sum of set within capacity, filling first[] as
+// described above when it isn't NULL
+int subsetSumReach(int set[], int n, int capacity, ShiftOrKernel kernel,
+                   int *first) {
+  int words = bitsetWords(capacity + 1);
+  uint64_t *reach = (uint64_t *)calloc(words, sizeof(uint64_t));
+  if (reach == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Sums past capacity are cleared after every element, or they would
+  // show up in the top word
+  uint64_t top_mask = ~0ULL >> (words * WORD_BITS - (capacity + 1));
+
+  reach[0] = 1;
+  for (int i = 0; i < n; i++) {
+    if (set[i] > 0 && set[i] <= capacity) {
+      kernel(reach, words, set[i], i, first);
+      reach[words - 1] &= top_mask;
+    }
+  }
+
+  int best = 0;
+  for (int j = words - 1; j >= 0; j--) {
+    if (reach[j] != 0) {
+      best = j * WORD_BITS + (WORD_BITS - 1 - __builtin_clzll(reach[j]));
+      break;
+    }
+  }
+
+  free(reach);
+  return best;
+}
+
+// Subset sum on a bitset, one bit per sum and a word-wide shift-or per
+// element. The elements are recovered from first[]: the element that first
+// reached a sum s added to a sum reached only by earlier elements, so
+// following s -= set[first[s]] down to zero uses each element once.
+SubsetSumSolution subsetSumBitset(int set[], int n, int capacity,
+                                  ShiftOrKernel kernel) {
+  if (n <= 0 || capacity <= 0) {
+    return (SubsetSumSolution){.selected = NULL,
+                               .n = 0,
+                               .value = 0,
+                               .remaining_capacity = capacity};
+  }
+
+  int *first = (int *)malloc((size_t)bitsetWords(capacity + 1) * WORD_BITS *
+                             sizeof(int));
+  int *selected = (int *)malloc(n * sizeof(int));
+  if (first == NULL || selected == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int best = subsetSumReach(set, n, capacity, kernel, first);
+
+  int count = 0;
+  for (int s = best; s > 0; s -= set[first[s]]) {
+    selected[count++] = set[first[s]];
+  }
+
+  free(first);
+
+  return (SubsetSumSolution){.selected = selected,
+                             .n = count,
+                             .value = best,
+                             .remaining_capacity = capacity - best};
+}
+
+SubsetSumSolution subsetSum(int set[], int n, int capacity) {
+  return subsetSumBitset(set, n, capacity, shiftOrKernel());
+}
+
+// The best sum alone skips first[], leaving one bit per sum
+int subsetSumValue(int set[], int n, int capacity) {
+  if (capacity <= 0) {
+    return 0;
+  }
+  return subsetSumReach(set, n, capacity, shiftOrKernel(), NULL);
+}
+
+// Meet in the middle needs one bit per element of a quarter in a mask
+#define MITM_MAX_ELEMENTS 64
+
+// One subset of a quarter of the set, as its sum and a bit per element
+typedef struct {
+  uint64_t sum;
+  uint32_t mask;
+} PartialSum;
+
+// Every subset sum of set in increasing order, built by merging the sums
+// so far with the same sums plus the next element. Sums are clamped to
+// limit, which keeps them in order and rules out overflow.
+PartialSum *sortedSubsetSums(const uint64_t set[], int n, uint64_t limit) {
+  size_t size = ((size_t)1 << n) * sizeof(PartialSum);
+  PartialSum *sums = (PartialSum *)malloc(size);
+  PartialSum *merged = (PartialSum *)malloc(size);
+  if (sums == NULL || merged == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  sums[0] = (PartialSum){.sum = 0, .mask = 0};
+  size_t count = 1;
+  for (int i = 0; i < n; i++) {
+    size_t a = 0;
+    size_t b = 0;
+    size_t k = 0;
+    while (b < count) {
+      uint64_t added = sums[b].sum + set[i];
+      if (added > limit) {
+        added = limit;
+      }
+      if (a < count && sums[a].sum <= added) {
+        merged[k++] = sums[a++];
+      } else {
+        merged[k++] =
+            (PartialSum){.sum = added, .mask = sums[b].mask | 1u << i};
+        b++;
+      }
+    }
+    while (a < count) {
+      merged[k++] = sums[a++];
+    }
+
+    PartialSum *swap = sums;
+    sums = merged;
+    merged = swap;
+    count *= 2;
+  }
+
+  free(merged);
+  return sums;
+}
+
+// The sums a[i] + b[j] of two sorted lists, streamed in increasing order,
+// or decreasing with descending. The heap holds one cursor into b per
+// entry of a, so the stream never stores more than the lists themselves.
+typedef struct {
+  uint64_t key;
+  size_t i;
+} StreamEntry;
+
+typedef struct {
+  const PartialSum *a;
+  const PartialSum *b;
+  size_t b_n;
+  bool descending;
+  uint64_t limit;
+  StreamEntry *heap;
+  size_t *step;
+  size_t size;
+} SumStream;
+
+size_t streamIndex(const SumStream *stream, size_t i) {
+  return stream->descending ? stream->b_n - 1 - stream->step[i]
+                            : stream->step[i];
+}
+
+uint64_t streamKey(const SumStream *stream, size_t i) {
+  uint64_t sum = stream->a[i].sum + stream->b[streamIndex(stream, i)].sum;
+  return sum > stream->limit ? stream->limit : sum;
+}
+
+bool streamBefore(const SumStream *stream, StreamEntry x, StreamEntry y) {
+  return stream->descending ? x.key > y.key : x.key < y.key;
+}
+
+void streamSiftDown(SumStream *stream, size_t k) {
+  StreamEntry entry = stream->heap[k];
+  while (true) {
+    size_t child = 2 * k + 1;
+    if (child >= stream->size) {
+      break;
+    }
+    if (child + 1 < stream->size &&
+        streamBefore(stream, stream->heap[child + 1], stream->heap[child])) {
+      child++;
+    }
+    if (!streamBefore(stream, stream->heap[child], entry)) {
+      break;
+    }
+    stream->heap[k] = stream->heap[child];
+    k = child;
+  }
+  stream->heap[k] = entry;
+}
+
+void streamInit(SumStream *stream, const PartialSum *a, size_t a_n,
+                const PartialSum *b, size_t b_n, bool descending,
+                uint64_t limit) {
+  StreamEntry *heap = (StreamEntry *)malloc(a_n * sizeof(StreamEntry));
+  *stream = (SumStream){.a = a,
+                        .b = b,
+                        .b_n = b_n,
+                        .descending = descending,
+                        .limit = limit,
+                        .heap = heap,
+                        .step = (size_t *)calloc(a_n, sizeof(size_t)),
+                        .size = a_n};
+  if (stream->heap == NULL || stream->step == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < a_n; i++) {
+    stream->heap[i] = (StreamEntry){.key = streamKey(stream, i), .i = i};
+  }
+  for (size_t k = a_n / 2; k-- > 0;) {
+    streamSiftDown(stream, k);
+  }
+}
+
+// Moves the cursor of the front entry on, dropping it at the end of b
+void streamAdvance(SumStream *stream) {
+  size_t i = stream->heap[0].i;
+  if (++stream->step[i] == stream->b_n) {
+    stream->heap[0] = stream->heap[--stream->size];
+  } else {
+    stream->heap[0].key = streamKey(stream, i);
+  }
+  streamSiftDown(stream, 0);
+}
+
+void streamFree(SumStream *stream) {
+  free(stream->heap);
+  free(stream->step);
+}
+
+// Exact subset sum for a few dozen elements with 64-bit weights, after
+// Schroeppel and Shamir. The set is split into quarters A, B, C and D,
+// each enumerated in sorted order. A + B is streamed up and C + D down,
+// and a two-pointer walk over the two streams finds the best total within
+// capacity in O(2^(n/2) log n) time but only O(2^(n/4)) memory.
+//
+// Elements that are negative or larger than capacity are skipped, and at
+// most MITM_MAX_ELEMENTS may remain.
+SubsetSumSolution64 subsetSumMeetInTheMiddle(const int64_t set[], int n,
+                                             int64_t capacity) {
+  if (capacity < 0) {
+    capacity = 0;
+  }
+
+  uint64_t *usable = (uint64_t *)malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    if (set[i] > 0 && set[i] <= capacity) {
+      if (m == MITM_MAX_ELEMENTS) {
+        fprintf(stderr, "Meet in the middle takes at most %d elements\n",
+                MITM_MAX_ELEMENTS);
+        exit(EXIT_FAILURE);
+      }
+      usable[m++] = set[i];
+    }
+  }
+
+  int sizes[4] = {m / 4, m / 2 - m / 4, (m - m / 2) / 2, 0};
+  sizes[3] = m - sizes[0] - sizes[1] - sizes[2];
+  int offsets[4] = {0, sizes[0], sizes[0] + sizes[1], m - sizes[3]};
+
+  // Clamping to capacity + 1 keeps sums of two quarters out of range
+  // without changing which totals fit
+  uint64_t limit = (uint64_t)capacity + 1;
+  PartialSum *quarters[4];
+  for (int q = 0; q < 4; q++) {
+    quarters[q] = sortedSubsetSums(usable + offsets[q], sizes[q], limit);
+  }
+
+  SumStream left;
+  SumStream right;
+  streamInit(&left, quarters[0], (size_t)1 << sizes[0], quarters[1],
+             (size_t)1 << sizes[1], false, limit);
+  streamInit(&right, quarters[2], (size_t)1 << sizes[2], quarters[3],
+             (size_t)1 << sizes[3], true, limit);
+
+  // Walking the left sums up, the right sum that fits only moves down
+  uint64_t best = 0;
+  uint32_t masks[4] = {0, 0, 0, 0};
+  while (left.size > 0 && best < (uint64_t)capacity) {
+    uint64_t l = left.heap[0].key;
+    if (l > (uint64_t)capacity) {
+      break;
+    }
+    while (right.size > 0 &&
+           l + right.heap[0].key > (uint64_t)capacity) {
+      streamAdvance(&right);
+    }
+    if (right.size == 0) {
+      break;
+    }
+
+    uint64_t total = l + right.heap[0].key;
+    if (total > best) {
+      best = total;
+      size_t i = left.heap[0].i;
+      size_t j = right.heap[0].i;
+      masks[0] = quarters[0][i].mask;
+      masks[1] = quarters[1][streamIndex(&left, i)].mask;
+      masks[2] = quarters[2][j].mask;
+      masks[3] = quarters[3][streamIndex(&right, j)].mask;
+    }
+    streamAdvance(&left);
+  }
+
+  int64_t *selected = (int64_t *)malloc((m > 0 ? m : 1) * sizeof(int64_t));
+  int count = 0;
+  for (int q = 0; q < 4; q++) {
+    for (int k = 0; k < sizes[q]; k++) {
+      if (masks[q] >> k & 1) {
+        selected[count++] = (int64_t)usable[offsets[q] + k];
+      }
+    }
+  }
+
+  streamFree(&left);
+  streamFree(&right);
+  for (int q = 0; q < 4; q++) {
+    free(quarters[q]);
+  }
+  free(usable);
+
+  return (SubsetSumSolution64){.selected = selected,
+                               .n = count,
+                               .value = (int64_t)best,
+                               .remaining_capacity =
+                                   capacity - (int64_t)best};
+}
+
+void printSubsetSumSolution(SubsetSumSolution solution) {
+  printf("Maximum value in subset sum = %d\n", solution.value);
+  printf("Remaining capacity = %d\n", solution.remaining_capacity);
+  printf("Number of items included = %d\n", solution.n);
+  printf("Items included in the subset sum:\n");
+  for (int i = 0; i < solution.n; i++) {
+    printf("Item %d: Weight = %d\n", i + 1, solution.selected[i]);
+  }
+}
+
+void printSubsetSumSolution64(SubsetSumSolution64 solution) {
+  printf("Maximum value in subset sum = %" PRId64 "\n", solution.value);
+  printf("Remaining capacity = %" PRId64 "\n", solution.remaining_capacity);
+  printf("Number of items included = %d\n", solution.n);
+  printf("Items included in the subset sum:\n");
+  for (int i = 0; i < solution.n; i++) {
+    printf("Item %d: Weight = %" PRId64 "\n", i + 1, solution.selected[i]);
+  }
+}
+
+// Parsing starts a thread per this many bytes at most, since smaller
+// inputs parse faster than the threads start
+#define PARSE_CHUNK_BYTES (1 << 20)
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+typedef struct {
+  const char *text;
+  size_t from;
+  size_t to;
+  int64_t *values;
+  size_t count;
+  size_t error;
+} ParseTask;
+
+// Parses the integers of bytes [from, to), which start and end between
+// numbers. error is left at SIZE_MAX, or set to the offset of the first
+// byte that isn't part of an integer.
+void *parseWorker(void *arg) {
+  ParseTask *task = (ParseTask *)arg;
+  const char *text = task->text;
+  size_t size = (task->to - task->from) / 4 + 16;
+  task->values = (int64_t *)malloc(size * sizeof(int64_t));
+  task->count = 0;
+  task->error = SIZE_MAX;
+  if (task->values == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t i = task->from;
+  while (i < task->to) {
+    if (isSpace(text[i])) {
+      i++;
+      continue;
+    }
+
+    size_t start = i;
+    bool negative = text[i] == '-';
+    if (text[i] == '-' || text[i] == '+') {
+      i++;
+    }
+    uint64_t value = 0;
+    size_t digits = i;
+    while (i < task->to && text[i] >= '0' && text[i] <= '9') {
+      int digit = text[i++] - '0';
+      if (value > (uint64_t)(INT64_MAX - digit) / 10) {
+        task->error = start;
+        return NULL;
+      }
+      value = value * 10 + digit;
+    }
+    if (i == digits || (i < task->to && !isSpace(text[i]))) {
+      task->error = start;
+      return NULL;
+    }
+
+    if (task->count == size) {
+      size *= 2;
+      task->values = (int64_t *)realloc(task->values, size * sizeof(int64_t));
+      if (task->values == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    task->values[task->count++] = negative ? -(int64_t)value : (int64_t)value;
+  }
+  return NULL;
+}
+
+// Parses whitespace separated decimal integers, like repeated scanf("%d")
+// but over the whole text at once. The text is cut into one chunk per
+// thread, each moved up to the next whitespace so no number is split, and
+// the chunks are parsed in parallel and joined. Returns the count and sets
+// *values, or returns -1 and sets *error to the offset of the first bad
+// byte. threads <= 0 uses every online core.
+long long parseIntegers(const char *text, size_t length, int threads,
+                        int64_t **values, size_t *error) {
+  if (threads <= 0) {
+    threads = defaultThreads();
+  }
+  if ((size_t)threads > length / PARSE_CHUNK_BYTES + 1) {
+    threads = (int)(length / PARSE_CHUNK_BYTES + 1);
+  }
+
+  ParseTask *tasks = (ParseTask *)malloc(threads * sizeof(ParseTask));
+  pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if (tasks == NULL || ids == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t from = 0;
+  for (int t = 0; t < threads; t++) {
+    size_t to = t == threads - 1 ? length : length / threads * (t + 1);
+    if (to < from) {
+      to = from;
+    }
+    while (to < length && to > 0 && !isSpace(text[to - 1])) {
+      to++;
+    }
+    tasks[t] = (ParseTask){.text = text, .from = from, .to = to};
+    from = to;
+  }
+
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&ids[t], NULL, parseWorker, &tasks[t]) != 0) {
+      fprintf(stderr, "Thread creation failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  parseWorker(&tasks[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+
+  long long count = 0;
+  *error = SIZE_MAX;
+  for (int t = 0; t < threads; t++) {
+    if (tasks[t].error != SIZE_MAX && *error == SIZE_MAX) {
+      *error = tasks[t].error;
+    }
+    count += tasks[t].count;
+  }
+
+  *values = NULL;
+  if (*error == SIZE_MAX) {
+    *values = (int64_t *)malloc((count > 0 ? count : 1) * sizeof(int64_t));
+    if (*values == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    long long offset = 0;
+    for (int t = 0; t < threads; t++) {
+      memcpy(*values + offset, tasks[t].values,
+             tasks[t].count * sizeof(int64_t));
+      offset += tasks[t].count;
+    }
+  }
+
+  for (int t = 0; t < threads; t++) {
+    free(tasks[t].values);
+  }
+  free(tasks);
+  free(ids);
+  return *error == SIZE_MAX ? count : -1;
+}
+
+#ifdef TEST
+bool testEqual(int actual, int expected) { return actual == expected; }
+
+int compareItems(const void *a, const void *b) {
+  Item *itemA = (Item *)a;
+  Item *itemB = (Item *)b;
+  if (itemA->weight != itemB->weight) {
+    return itemA->weight - itemB->weight;
+  }
+  return itemA->value - itemB->value;
+}
+
+int compareInts(const void *a, const void *b) {
+  return (*(int *)a - *(int *)b);
+}
+
+bool testItemArrayEqual(Item *actual, Item *expected, int size) {
+  qsort(actual, size, sizeof(Item), compareItems);
+  qsort(expected, size, sizeof(Item), compareItems);
+
+  for (int i = 0; i < size; i++) {
+    if (actual[i].weight != expected[i].weight ||
+        actual[i].value != expected[i].value) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool testIntArrayEqual(int *actual, int *expected, int size) {
+  qsort(actual, size, sizeof(int), compareInts);
+  qsort(expected, size, sizeof(int), compareInts);
+
+  for (int i = 0; i < size; i++) {
+    if (actual[i] != expected[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool testKnapsackSolutionEqual(KnapsackSolution actual,
+                               KnapsackSolution expected) {
+  if (!testEqual(actual.value, expected.value) ||
+      !testEqual(actual.remaining_capacity, expected.remaining_capacity) ||
+      !testEqual(actual.n, expected.n)) {
+    return false;
+  }
+
+  return testItemArrayEqual(actual.selected, expected.selected, actual.n);
+}
+
+bool testSubsetSumSolutionEqual(SubsetSumSolution actual,
+                                SubsetSumSolution expected) {
+  if (!testEqual(actual.value, expected.value) ||
+      !testEqual(actual.remaining_capacity, expected.remaining_capacity) ||
+      !testEqual(actual.n, expected.n)) {
+    return false;
+  }
+  return testIntArrayEqual(actual.selected, expected.selected, actual.n);
+}
+
+void checkKnapsackSolution(KnapsackSolution actual, KnapsackSolution expected) {
+  if (!testKnapsackSolutionEqual(actual, expected)) {
+    printf("Test failed!\n");
+    printf("\n");
+    printf("Actual:\n");
+    printKnapsackSolution(actual);
+    printf("\n");
+    printf("Expected:\n");
+    printKnapsackSolution(expected);
+
+    exit(1);
+  }
+}
+
+void checkSubsetSumSolution(SubsetSumSolution actual,
+                            SubsetSumSolution expected) {
+  if (!testSubsetSumSolutionEqual(actual, expected)) {
+    printf("Test failed!\n");
+    printf("\n");
+    printf("Actual:\n");
+    printSubsetSumSolution(actual);
+    printf("\n");
+    printf("Expected:\n");
+    printSubsetSumSolution(expected);
+
+    exit(1);
+  }
+}
+
+// The selected items fit and add up to the reported value
+void checkKnapsackSelection(KnapsackSolution solution, int capacity) {
+  int weight = 0;
+  int value = 0;
+  for (int i = 0; i < solution.n; i++) {
+    weight += solution.selected[i].weight;
+    value += solution.selected[i].value;
+  }
+
+  if (weight > capacity || weight != capacity - solution.remaining_capacity ||
+      value != solution.value) {
+    printf("Test failed!\n");
+    printf("\n");
+    printf("Inconsistent selection:\n");
+    printKnapsackSolution(solution);
+
+    exit(1);
+  }
+}
+
+// Best value over every subset, for small n
+int bruteForceKnapsack(Item items[], int n, int capacity) {
+  int best = 0;
+  for (int mask = 0; mask < 1 << n; mask++) {
+    int weight = 0;
+    int value = 0;
+    for (int i = 0; i < n; i++) {
+      if (mask >> i & 1) {
+        weight += items[i].weight;
+        value += items[i].value;
+      }
+    }
+    if (weight <= capacity && value > best) {
+      best = value;
+    }
+  }
+  return best;
+}
+
+// Checks a subset sum solution against the best sum found by a plain
+// boolean table
+void checkSubsetSum(SubsetSumSolution solution, int set[], int n,
+                    int capacity) {
+  bool *reach = (bool *)calloc(capacity + 1, sizeof(bool));
+  reach[0] = true;
+  for (int i = 0; i < n; i++) {
+    for (int s = capacity; s >= set[i]; s--) {
+      reach[s] = reach[s] || reach[s - set[i]];
+    }
+  }
+  int best = capacity;
+  while (!reach[best]) {
+    best--;
+  }
+  free(reach);
+
+  int sum = 0;
+  for (int i = 0; i < solution.n; i++) {
+    sum += solution.selected[i];
+  }
+
+  if (solution.value != best || sum != best ||
+      solution.remaining_capacity != capacity - best) {
+    printf("Test failed!\n");
+    printf("\n");
+    printf("Expected a best sum of %d, got:\n", best);
+    printSubsetSumSolution(solution);
+
+    exit(1);
+  }
+}
+
+// Deterministic pseudo-random items for the larger cases
+void randomItems(Item items[], int n, int max_weight, int max_value,
+                 unsigned *seed) {
+  for (int i = 0; i < n; i++) {
+    *seed = *seed * 1103515245 + 12345;
+    items[i].weight = 1 + (*seed >> 8) % max_weight;
+    *seed = *seed * 1103515245 + 12345;
+    items[i].value = 1 + (*seed >> 8) % max_value;
+  }
+}
+
+int main() {
+  // Test case 1
+  {
+    int capacity = 50;
+    Item items[] = {{10, 60}, {20, 100}, {30, 30}};
+    int n = sizeof(items) / sizeof(items[0]);
+
+    KnapsackSolution expected = {.selected = (Item[]){items[0], items[1]},
+                                 .n = 2,
+                                 .value = 160,
+                                 .remaining_capacity = 20};
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 2
+  {
+    int capacity = 0;
+    Item items[] = {{10, 60}, {20, 100}, {30, 30}};
+    int n = sizeof(items) / sizeof(items[0]);
+
+    KnapsackSolution expected = {
+        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 0};
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 3
+  {
+    int capacity = 50;
+    Item items[] = {};
+    int n = sizeof(items) / sizeof(items[0]);
+
+    KnapsackSolution expected = {
+        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 50};
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 4
+  {
+    int capacity = 50;
+    Item items[] = {{60, 100}, {100, 200}, {120, 300}};
+    int n = sizeof(items) / sizeof(items[0]);
+
+    KnapsackSolution expected = {
+        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 50};
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 5
+  {
+    int capacity = 50;
+    Item items[] = {{10, 60}, {20, 100}, {30, 120}};
+    int n = sizeof(items) / sizeof(items[0]);
+
+    KnapsackSolution expected = {.selected = (Item[]){items[1], items[2]},
+                                 .n = 2,
+                                 .value = 220,
+                                 .remaining_capacity = 0};
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 6
+  {
+    int capacity = 9;
+    int set[] = {1, 2, 3, 4, 5};
+    int n = sizeof(set) / sizeof(set[0]);
+
+    SubsetSumSolution expected = {.selected = (int[]){set[1], set[2], set[3]},
+                                  .n = 3,
+                                  .value = 9,
+                                  .remaining_capacity = 0};
+
+    SubsetSumSolution solution = subsetSum(set, n, capacity);
+    checkSubsetSumSolution(solution, expected);
+
+    free(solution.selected);
+  }
+
+  // Test case 7
+  {
+    unsigned seed = 7;
+    for (int t = 0; t < 200; t++) {
+      Item items[12];
+      int n = 1 + t % 12;
+      int capacity = t % 50;
+      randomItems(items, n, 20, 100, &seed);
+
+      int expected = bruteForceKnapsack(items, n, capacity);
+      KnapsackSolution solution = knapsack(items, n, capacity);
+      checkKnapsackSelection(solution, capacity);
+      if (solution.value != expected ||
+          knapsackValue(items, n, capacity) != expected) {
+        printf("Test failed!\n");
+        printf("Random instance %d: expected %d, got %d and %d\n", t,
+               expected, solution.value, knapsackValue(items, n, capacity));
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+  }
+
+  // Test case 8
+  {
+    unsigned seed = 8;
+    for (int t = 0; t < 200; t++) {
+      Item items[12];
+      int n = 1 + t % 12;
+      int capacity = t % 50;
+      randomItems(items, n, 20, 100, &seed);
+
+      int expected = bruteForceKnapsack(items, n, capacity);
+      KnapsackSolution solution = knapsackHirschberg(items, n, capacity);
+      checkKnapsackSelection(solution, capacity);
+      if (solution.value != expected) {
+        printf("Test failed!\n");
+        printf("Random instance %d: expected %d, got %d\n", t, expected,
+               solution.value);
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+  }
+
+  // Test case 9
+  {
+    // Used to overflow the stack with an (n + 1) x (capacity + 1) table
+    int capacity = 100000;
+    int n = 1000;
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    unsigned seed = 8;
+    randomItems(items, n, 1000, 1000, &seed);
+
+    KnapsackSolution solution = knapsack(items, n, capacity);
+    checkKnapsackSelection(solution, capacity);
+    if (solution.value != knapsackValue(items, n, capacity)) {
+      printf("Test failed!\n");
+      printf("Value-only mode disagrees: %d\n", solution.value);
+      exit(1);
+    }
+
+    KnapsackSolution linear = knapsackHirschberg(items, n, capacity);
+    checkKnapsackSelection(linear, capacity);
+    if (linear.value != solution.value) {
+      printf("Test failed!\n");
+      printf("Hirschberg disagrees: %d\n", linear.value);
+      exit(1);
+    }
+
+    free(solution.selected);
+    free(linear.selected);
+    free(items);
+  }
+
+  // Test case 10
+  {
+    unsigned seed = 10;
+    int capacities[] = {1, 63, 4095, 4096, 20000};
+    int threads[] = {2, 3, 8, 0};
+    for (int c = 0; c < 5; c++) {
+      int capacity = capacities[c];
+      int n = 60;
+      Item items[60];
+      randomItems(items, n, capacity / 4 + 1, 1000, &seed);
+
+      KnapsackSolution expected = knapsack(items, n, capacity);
+      for (int t = 0; t < 4; t++) {
+        KnapsackSolution solution =
+            knapsackParallel(items, n, capacity, threads[t]);
+        // Identical down to the order of the selected items
+        if (solution.value != expected.value || solution.n != expected.n ||
+            solution.remaining_capacity != expected.remaining_capacity ||
+            memcmp(solution.selected, expected.selected,
+                   solution.n * sizeof(Item)) != 0 ||
+            knapsackValueParallel(items, n, capacity, threads[t]) !=
+                expected.value) {
+          printf("Test failed!\n");
+          printf("Parallel knapsack with %d threads differs at capacity %d\n",
+                 threads[t], capacity);
+          exit(1);
+        }
+        free(solution.selected);
+      }
+      free(expected.selected);
+    }
+  }
+
+  // Test case 11
+  {
+    // The selected row kernel against the scalar one, in place and not,
+    // over ranges and weights that straddle the vector blocks
+    unsigned seed = 11;
+    int size = 300;
+    int words = bitsetWords(size);
+    int prev[300], expected[300], actual[300];
+    uint64_t expected_take[5], actual_take[5];
+    RowKernel kernel = selectRowKernel();
+
+    for (int t = 0; t < 2000; t++) {
+      for (int w = 0; w < size; w++) {
+        seed = seed * 1103515245 + 12345;
+        prev[w] = (seed >> 8) % 1000;
+      }
+      seed = seed * 1103515245 + 12345;
+      int from = (seed >> 8) % size;
+      int to = from + (seed >> 16) % (size - from + 1);
+      int weight = (seed >> 4) % 40;
+      int value = (seed >> 12) % 200;
+      bool in_place = t % 2 == 0;
+
+      memcpy(expected, prev, sizeof(prev));
+      memcpy(actual, prev, sizeof(prev));
+      memset(expected_take, 0, sizeof(expected_take));
+      memset(actual_take, 0, sizeof(actual_take));
+      rowScalar(in_place ? expected : prev, expected, expected_take, from, to,
+                weight, value);
+      kernel(in_place ? actual : prev, actual, actual_take, from, to, weight,
+             value);
+
+      if (memcmp(expected, actual, sizeof(expected)) != 0 ||
+          memcmp(expected_take, actual_take, words * sizeof(uint64_t)) != 0) {
+        printf("Test failed!\n");
+        printf("Row kernel differs: cells [%d, %d), weight %d, %s\n", from,
+               to, weight, in_place ? "in place" : "out of place");
+        exit(1);
+      }
+    }
+  }
+
+  // Test case 12
+  {
+    ShiftOrKernel kernels[] = {shiftOrScalar, shiftOrKernel()};
+    unsigned seed = 10;
+    for (int t = 0; t < 400; t++) {
+      int set[40];
+      int n = 1 + t % 40;
+      int capacity = 1 + (t * 37) % 700;
+      int max_element = 1 + t % 200;
+      for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        set[i] = 1 + (seed >> 8) % max_element;
+      }
+
+      for (int k = 0; k < 2; k++) {
+        SubsetSumSolution solution =
+            subsetSumBitset(set, n, capacity, kernels[k]);
+        checkSubsetSum(solution, set, n, capacity);
+        if (subsetSumValue(set, n, capacity) != solution.value) {
+          printf("Test failed!\n");
+          printf("Value-only subset sum disagrees: %d\n", solution.value);
+          exit(1);
+        }
+        free(solution.selected);
+      }
+    }
+  }
+
+  // Test case 13
+  {
+    int n = 200;
+    int capacity = 200003;
+    int *set = (int *)malloc(n * sizeof(int));
+    unsigned seed = 11;
+    for (int i = 0; i < n; i++) {
+      seed = seed * 1103515245 + 12345;
+      set[i] = 1000 + (seed >> 8) % 20000;
+    }
+
+    SubsetSumSolution solution = subsetSum(set, n, capacity);
+    checkSubsetSum(solution, set, n, capacity);
+
+    free(solution.selected);
+    free(set);
+  }
+
+  // Test case 14
+  {
+    unsigned seed = 14;
+    for (int t = 0; t < 400; t++) {
+      Item items[12];
+      int n = 1 + t % 12;
+      int capacity = t % 60;
+      randomItems(items, n, 20, 100, &seed);
+
+      int expected = bruteForceKnapsack(items, n, capacity);
+      for (int reduce = 0; reduce < 2; reduce++) {
+        KnapsackSolution solution =
+            knapsackBranchAndBound(items, n, capacity, reduce);
+        checkKnapsackSelection(solution, capacity);
+        if (solution.value != expected) {
+          printf("Test failed!\n");
+          printf("Random instance %d: expected %d, got %d\n", t, expected,
+                 solution.value);
+          exit(1);
+        }
+
+        free(solution.selected);
+      }
+    }
+  }
+
+  // Test case 15
+  {
+    // Capacities far beyond what a table can hold
+    unsigned seed = 15;
+    for (int t = 0; t < 20; t++) {
+      Item items[18];
+      int n = 18;
+      int capacity = 300000000 + t * 20000000;
+      randomItems(items, n, 100000000, 1000000, &seed);
+
+      int expected = bruteForceKnapsack(items, n, capacity);
+      KnapsackSolution solution =
+          knapsackBranchAndBound(items, n, capacity, true);
+      checkKnapsackSelection(solution, capacity);
+      if (solution.value != expected) {
+        printf("Test failed!\n");
+        printf("Huge capacity %d: expected %d, got %d\n", capacity,
+               expected, solution.value);
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+
+    int n = 1000;
+    int capacity = 100000;
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    randomItems(items, n, 1000, 1000, &seed);
+
+    int expected = knapsackValue(items, n, capacity);
+    for (int reduce = 0; reduce < 2; reduce++) {
+      KnapsackSolution solution =
+          knapsackBranchAndBound(items, n, capacity, reduce);
+      checkKnapsackSelection(solution, capacity);
+      if (solution.value != expected) {
+        printf("Test failed!\n");
+        printf("Branch and bound disagrees: expected %d, got %d\n",
+               expected, solution.value);
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+
+    free(items);
+
+    // Equal densities leave a core of every item, so the search runs a
+    // million items deep, too deep for a recursion on the default stack
+    n = 1000000;
+    items = (Item *)malloc(n * sizeof(Item));
+    for (int i = 0; i < n; i++) {
+      items[i] = (Item){.weight = 2, .value = 2};
+    }
+    KnapsackSolution solution =
+        knapsackBranchAndBound(items, n, 2 * n - 1, true);
+    if (solution.value != 2 * n - 2 || solution.n != n - 1) {
+      printf("Test failed!\n");
+      printf("Deep core: expected %d, got %d\n", 2 * n - 2, solution.value);
+      exit(1);
+    }
+    free(solution.selected);
+    free(items);
+  }
+
+  // Test case 16
+  {
+    // Weights near 2^60, checked against every subset
+    unsigned seed = 16;
+    for (int t = 0; t < 100; t++) {
+      int64_t set[14];
+      int n = t % 15;
+      for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        set[i] = ((int64_t)1 << 60) / (1 + (seed >> 8) % 16) + (seed >> 16);
+      }
+      int64_t capacity = ((int64_t)1 << 60) / 4 * (1 + t % 8) + t;
+
+      int64_t best = 0;
+      for (int mask = 0; mask < 1 << n; mask++) {
+        int64_t sum = 0;
+        for (int i = 0; i < n; i++) {
+          if (mask >> i & 1) {
+            sum += set[i];
+          }
+        }
+        if (sum <= capacity && sum > best) {
+          best = sum;
+        }
+      }
+
+      SubsetSumSolution64 solution = subsetSumMeetInTheMiddle(set, n, capacity);
+      int64_t sum = 0;
+      for (int i = 0; i < solution.n; i++) {
+        sum += solution.selected[i];
+      }
+      if (solution.value != best || sum != best ||
+          solution.remaining_capacity != capacity - best) {
+        printf("Test failed!\n");
+        printf("Random instance %d: expected %" PRId64 "\n", t, best);
+        printSubsetSumSolution64(solution);
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+  }
+
+  // Test case 17
+  {
+    // Agrees with the bitset on 40 small elements, and finds a planted
+    // exact sum among 48 huge ones
+    int n = 40;
+    int set[40];
+    int64_t wide[48];
+    unsigned seed = 17;
+    for (int i = 0; i < n; i++) {
+      seed = seed * 1103515245 + 12345;
+      set[i] = 1000 + (seed >> 8) % 100000;
+      wide[i] = set[i];
+    }
+    int capacities[] = {0, 999, 123457, 1000003};
+    for (int c = 0; c < 4; c++) {
+      int expected = subsetSumValue(set, n, capacities[c]);
+      SubsetSumSolution64 solution =
+          subsetSumMeetInTheMiddle(wide, n, capacities[c]);
+      if (solution.value != expected) {
+        printf("Test failed!\n");
+        printf("Capacity %d: expected %d, got %" PRId64 "\n", capacities[c],
+               expected, solution.value);
+        exit(1);
+      }
+
+      free(solution.selected);
+    }
+
+    int64_t planted = 0;
+    for (int i = 0; i < 48; i++) {
+      seed = seed * 1103515245 + 12345;
+      wide[i] = ((int64_t)(seed >> 4) << 32 | seed) & (((int64_t)1 << 57) - 1);
+      if (i % 3 == 0) {
+        planted += wide[i];
+      }
+    }
+    SubsetSumSolution64 solution = subsetSumMeetInTheMiddle(wide, 48, planted);
+    int64_t sum = 0;
+    for (int i = 0; i < solution.n; i++) {
+      sum += solution.selected[i];
+    }
+    if (solution.value != planted || sum != planted) {
+      printf("Test failed!\n");
+      printf("Expected the planted sum %" PRId64 "\n", planted);
+      printSubsetSumSolution64(solution);
+      exit(1);
+    }
+
+    free(solution.selected);
+  }
+
+  // Test case 18
+  {
+    // One table for every capacity matches a table per capacity
+    int n = 300;
+    Item *items = (Item *)malloc(n * sizeof(Item));
+    unsigned seed = 18;
+    randomItems(items, n, 500, 1000, &seed);
+    int capacities[] = {20000, 0, 1, 63, 64, 4097, 12345, 19999, -5};
+    int count = sizeof(capacities) / sizeof(capacities[0]);
+
+    for (int threads = 1; threads <= 3; threads += 2) {
+      KnapsackSolution *solutions =
+          knapsackBatch(items, n, capacities, count, threads);
+      int *values = knapsackValues(items, n, 20000, threads);
+      for (int c = 0; c < count; c++) {
+        int expected = knapsackValue(items, n, capacities[c]);
+        if (capacities[c] >= 0) {
+          checkKnapsackSelection(solutions[c], capacities[c]);
+        }
+        if (solutions[c].value != expected ||
+            (capacities[c] >= 0 && values[capacities[c]] != expected)) {
+          printf("Test failed!\n");
+          printf("Capacity %d: expected %d, got %d\n", capacities[c],
+                 expected, solutions[c].value);
+          exit(1);
+        }
+
+        free(solutions[c].selected);
+      }
+
+      free(solutions);
+      free(values);
+    }
+
+    free(items);
+  }
+
+  // Test case 19
+  {
+    // Over several chunks, so numbers meet the chunk boundaries
+    int n = 500000;
+    int64_t *expected = (int64_t *)malloc(n * sizeof(int64_t));
+    char *text = (char *)malloc((size_t)n * 24);
+    size_t length = 0;
+    unsigned seed = 19;
+    for (int i = 0; i < n; i++) {
+      seed = seed * 1103515245 + 12345;
+      expected[i] = ((int64_t)seed << (i % 32)) - (i % 3 == 0 ? seed : 0);
+      length += sprintf(text + length, "%" PRId64 "%s", expected[i],
+                        i % 7 == 0 ? "\n" : " ");
+    }
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+      int64_t *values;
+      size_t error;
+      long long count = parseIntegers(text, length, threads, &values, &error);
+      if (count != n || memcmp(values, expected, n * sizeof(int64_t)) != 0) {
+        printf("Test failed!\n");
+        printf("Parsed %lld integers with %d threads\n", count, threads);
+        exit(1);
+      }
+      free(values);
+    }
+
+    const char *bad[] = {"12 3x 4", "1 2 -", "9223372036854775808", "7 +-1"};
+    size_t offsets[] = {3, 4, 0, 2};
+    for (int i = 0; i < 4; i++) {
+      int64_t *values;
+      size_t error;
+      if (parseIntegers(bad[i], strlen(bad[i]), 2, &values, &error) != -1 ||
+          error != offsets[i]) {
+        printf("Test failed!\n");
+        printf("Expected '%s' to fail at byte %zu\n", bad[i], offsets[i]);
+        exit(1);
+      }
+    }
+
+    const char *signs = " \n-9223372036854775807\t+5 ";
+    int64_t *values;
+    size_t error;
+    if (parseIntegers(signs, strlen(signs), 1, &values, &error) != 2 ||
+        values[0] != -INT64_MAX || values[1] != 5) {
+      printf("Test failed!\n");
+      printf("Signs and whitespace\n");
+      exit(1);
+    }
+    free(values);
+
+    free(text);
+    free(expected);
+  }
+
+  // Test case 20
+  {
+    // Values past int, against every subset, and the int engine on the
+    // same weights with small values
+    unsigned seed = 20;
+    for (int t = 0; t < 200; t++) {
+      Item items[12];
+      Item64 wide[12];
+      int n = 1 + t % 12;
+      int capacity = t % 70;
+      randomItems(items, n, 1 + t % 30, 1000, &seed);
+      for (int i = 0; i < n; i++) {
+        wide[i] = (Item64){.weight = items[i].weight,
+                           .value = (int64_t)items[i].value << 40 | i};
+      }
+
+      int64_t best = 0;
+      for (int mask = 0; mask < 1 << n; mask++) {
+        int64_t weight = 0;
+        int64_t value = 0;
+        for (int i = 0; i < n; i++) {
+          if (mask >> i & 1) {
+            weight += wide[i].weight;
+            value += wide[i].value;
+          }
+        }
+        if (weight <= capacity && value > best) {
+          best = value;
+        }
+      }
+
+      KnapsackSolution64 solution = knapsack64(wide, n, capacity);
+      int64_t weight = 0;
+      int64_t value = 0;
+      for (int i = 0; i < solution.n; i++) {
+        weight += solution.selected[i].weight;
+        value += solution.selected[i].value;
+      }
+      if (solution.overflow || solution.value != best || value != best ||
+          weight != capacity - solution.remaining_capacity ||
+          knapsackValue64(wide, n, capacity) != best) {
+        printf("Test failed!\n");
+        printf("Random instance %d: expected %" PRId64 "\n", t, best);
+        printKnapsackSolution64(solution);
+        exit(1);
+      }
+      free(solution.selected);
+
+      for (int i = 0; i < n; i++) {
+        wide[i].value = items[i].value;
+      }
+      if (knapsackValue64(wide, n, capacity) !=
+          knapsackValue(items, n, capacity)) {
+        printf("Test failed!\n");
+        printf("Random instance %d disagrees with the int table\n", t);
+        exit(1);
+      }
+    }
+
+    Item64 huge[3] = {{1, INT64_MAX / 2}, {1, INT64_MAX / 2}, {1, 2}};
+    if (!knapsack64(huge, 3, 3).overflow ||
+        knapsackValue64(huge, 3, 3) != -1 || !knapsackValuesFit64(huge, 2)) {
+      printf("Test failed!\n");
+      printf("Expected an overflow\n");
+      exit(1);
+    }
+
+    Item narrow[2] = {{1, INT_MAX}, {1, 1}};
+    if (knapsackValuesFit(narrow, 2) || !knapsackValuesFit(narrow, 1)) {
+      printf("Test failed!\n");
+      printf("Expected int values to overflow\n");
+      exit(1);
+    }
+  }
+
+  // Test case 21
+  {
+    // Binary splitting agrees with duplicating every copy
+    unsigned seed = 21;
+    for (int t = 0; t < 100; t++) {
+      int n = 1 + t % 8;
+      int capacity = 50 + t * 7;
+      Item kinds[8];
+      BoundedItem items[8];
+      Item copies[8 * 40];
+      int m = 0;
+      randomItems(kinds, n, 40, 100, &seed);
+      for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        items[i] = (BoundedItem){.weight = kinds[i].weight,
+                                 .value = kinds[i].value,
+                                 .count = (seed >> 8) % 40};
+        for (int k = 0; k < items[i].count; k++) {
+          copies[m++] = kinds[i];
+        }
+      }
+
+      int expected = knapsackValue(copies, m, capacity);
+      BoundedSolution solution = knapsackBounded(items, n, capacity);
+      int weight = 0;
+      int value = 0;
+      for (int i = 0; i < n; i++) {
+        if (solution.counts[i] < 0 || solution.counts[i] > items[i].count) {
+          printf("Test failed!\n");
+          printf("Item %d taken %d times\n", i, solution.counts[i]);
+          exit(1);
+        }
+        weight += solution.counts[i] * items[i].weight;
+        value += solution.counts[i] * items[i].value;
+      }
+      if (solution.value != expected || value != expected ||
+          weight != capacity - solution.remaining_capacity) {
+        printf("Test failed!\n");
+        printf("Bounded instance %d: expected %d, got\n", t, expected);
+        printBoundedSolution(solution, kinds);
+        exit(1);
+      }
+
+      free(solution.counts);
+    }
+
+    BoundedItem many[1] = {{1, 1000, INT_MAX}};
+    BoundedSolution solution = knapsackBounded(many, 1, 1000000);
+    if (solution.value != 1000000000 || solution.counts[0] != 1000000) {
+      printf("Test failed!\n");
+      printf("Expected a million copies\n");
+      exit(1);
+    }
+    free(solution.counts);
+    if (!knapsackBounded(many, 1, 3000000).overflow) {
+      printf("Test failed!\n");
+      printf("Expected an overflow\n");
+      exit(1);
+    }
+
+    // Weight 0 keeps every copy, so the pieces go up to 2^30
+    BoundedItem free_copies[1] = {{0, 1, INT_MAX}};
+    solution = knapsackBounded(free_copies, 1, 10);
+    if (solution.overflow || solution.value != INT_MAX ||
+        solution.counts[0] != INT_MAX) {
+      printf("Test failed!\n");
+      printf("Expected every free copy\n");
+      exit(1);
+    }
+    free(solution.counts);
+  }
+
+  // Test case 22
+  {
+    // The forward row against every count per item
+    unsigned seed = 22;
+    for (int t = 0; t < 100; t++) {
+      int n = 1 + t % 8;
+      int capacity = t * 13;
+      Item items[8];
+      randomItems(items, n, 60, 100, &seed);
+
+      int *best = (int *)calloc(capacity + 1, sizeof(int));
+      for (int w = 1; w <= capacity; w++) {
+        for (int i = 0; i < n; i++) {
+          if (items[i].weight <= w &&
+              best[w - items[i].weight] + items[i].value > best[w]) {
+            best[w] = best[w - items[i].weight] + items[i].value;
+          }
+        }
+      }
+
+      BoundedSolution solution = knapsackUnbounded(items, n, capacity);
+      int weight = 0;
+      int value = 0;
+      for (int i = 0; i < n; i++) {
+        weight += solution.counts[i] * items[i].weight;
+        value += solution.counts[i] * items[i].value;
+      }
+      if (solution.value != best[capacity] || value != best[capacity] ||
+          weight != capacity - solution.remaining_capacity) {
+        printf("Test failed!\n");
+        printf("Unbounded instance %d: expected %d, got\n", t,
+               best[capacity]);
+        printBoundedSolution(solution, items);
+        exit(1);
+      }
+
+      free(solution.counts);
+      free(best);
+    }
+
+    // Weight 0 is skipped, and 3000000 * 2000 / 3 fits an int
+    Item dense[2] = {{0, 5}, {3, 2000}};
+    BoundedSolution solution = knapsackUnbounded(dense, 2, 3000000);
+    if (solution.overflow || solution.value != 2000000000 ||
+        solution.counts[0] != 0 ||
+        !knapsackUnbounded(dense, 2, 4000000).overflow) {
+      printf("Test failed!\n");
+      printf("Expected the overflow bound at 2^31\n");
+      exit(1);
+    }
+    free(solution.counts);
+
+    // Each item alone fits an int at capacity 5, but one of each does not
+    Item mixed[2] = {{3, INT_MAX - 10}, {2, 20}};
+    if (!knapsackUnbounded(mixed, 2, 5).overflow) {
+      printf("Test failed!\n");
+      printf("Expected an overflow from mixing items\n");
+      exit(1);
+    }
+  }
+
+  printf("All test cases passed!\n");
+}
+
+#elif defined(BENCHMARK)
+#include <time.h>
+
+double nowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Cells per second of one kernel running the in-place rolling row over
+// every item, with or without the take bits
+double cellsPerSecond(RowKernel kernel, Item items[], int n, int capacity,
+                      bool decisions) {
+  int words = bitsetWords(capacity + 1);
+  int *dp = (int *)calloc(capacity + 1, sizeof(int));
+  uint64_t *take = (uint64_t *)calloc(words, sizeof(uint64_t));
+
+  double start = nowSeconds();
+  double elapsed = 0;
+  long cells = 0;
+  while (elapsed < 0.5) {
+    memset(dp, 0, (capacity + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+      kernel(dp, dp, decisions ? take : NULL, 0, capacity + 1,
+             items[i].weight, items[i].value);
+    }
+    cells += (long)n * (capacity + 1);
+    elapsed = nowSeconds() - start;
+  }
+
+  free(dp);
+  free(take);
+  return cells / elapsed;
+}
+
+int main() {
+  struct {
+    const char *name;
+    RowKernel kernel;
+  } kernels[] = {
+      {"scalar", rowScalar},
+#if defined(__x86_64__)
+      {"avx2", rowAvx2},
+#endif
+  };
+  int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+  int capacities[] = {1000, 100000, 10000000};
+
+  int n = 200;
+  Item *items = (Item *)malloc(n * sizeof(Item));
+  unsigned seed = 1;
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    items[i].weight = 1 + (seed >> 8) % 1000;
+    seed = seed * 1103515245 + 12345;
+    items[i].value = 1 + (seed >> 8) % 1000;
+  }
+
+  printf("%10s %8s %18s %18s\n", "capacity", "kernel", "value-only",
+         "with decisions");
+  for (int c = 0; c < 3; c++) {
+    for (int k = 0; k < kernel_count; k++) {
+#if defined(__x86_64__)
+      if (kernels[k].kernel == rowAvx2 && !__builtin_cpu_supports("avx2")) {
+        continue;
+      }
+#endif
+      printf("%10d %8s %12.3e cells/s %12.3e cells/s\n", capacities[c],
+             kernels[k].name,
+             cellsPerSecond(kernels[k].kernel, items, n, capacities[c], false),
+             cellsPerSecond(kernels[k].kernel, items, n, capacities[c], true));
+    }
+  }
+
+  free(items);
+}
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+double nowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double startSeconds;
+
+// Wall time since startup and peak memory, written to stderr at exit with
+// --stats so benchmark.sh doesn't depend on an external time tool
+void printStats() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fflush(stdout);
+  fprintf(stderr, "Time = %.6f s\n", nowSeconds() - startSeconds);
+  fprintf(stderr, "Peak memory = %.1f MiB\n", usage.ru_maxrss / 1024.0);
 }
 
-bool testIntArrayEqual(int *actual, int *expected, int size) {
-  qsort(actual, size, sizeof(int), compareInts);
-  qsort(expected, size, sizeof(int), compareInts);
+// The input text or item file. Regular files are mapped instead of read,
+// so parsing starts without a copy; pipes and terminals are read into a
+// buffer.
+typedef struct {
+  const char *text;
+  size_t length;
+  void *map;
+  char *buffer;
+} Source;
+
+// path NULL reads stdin
+Source openSource(const char *path) {
+  Source source = {0};
+  int fd = path == NULL ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Cannot open '%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
 
-  for (int i = 0; i < size; i++) {
-    if (actual[i] != expected[i]) {
-      return false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      source.text = (const char *)map;
+      source.length = st.st_size;
+      source.map = map;
     }
   }
 
-  return true;
-}
-
-bool testKnapsackSolutionEqual(KnapsackSolution actual,
-                               KnapsackSolution expected) {
-  if (!testEqual(actual.value, expected.value) ||
-      !testEqual(actual.remaining_capacity, expected.remaining_capacity) ||
-      !testEqual(actual.n, expected.n)) {
-    return false;
+  if (source.map == NULL) {
+    size_t size = 1 << 16;
+    source.buffer = (char *)malloc(size);
+    ssize_t r;
+    while (source.buffer != NULL &&
+           (r = read(fd, source.buffer + source.length,
+                     size - source.length)) > 0) {
+      source.length += r;
+      if (source.length == size) {
+        size *= 2;
+        source.buffer = (char *)realloc(source.buffer, size);
+      }
+    }
+    if (source.buffer == NULL) {
+      fprintf(stderr, "Memory allocation failed\n");
+      exit(EXIT_FAILURE);
+    }
+    source.text = source.buffer;
   }
 
-  return testItemArrayEqual(actual.selected, expected.selected, actual.n);
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  return source;
 }
 
-bool testSubsetSumSolutionEqual(SubsetSumSolution actual,
-                                SubsetSumSolution expected) {
-  if (!testEqual(actual.value, expected.value) ||
-      !testEqual(actual.remaining_capacity, expected.remaining_capacity) ||
-      !testEqual(actual.n, expected.n)) {
-    return false;
+void closeSource(Source source) {
+  if (source.map != NULL) {
+    munmap(source.map, source.length);
   }
-  return testIntArrayEqual(actual.selected, expected.selected, actual.n);
+  free(source.buffer);
 }
 
-void checkKnapsackSolution(KnapsackSolution actual, KnapsackSolution expected) {
-  if (!testKnapsackSolutionEqual(actual, expected)) {
-    printf("Test failed!\n");
-    printf("\n");
-    printf("Actual:\n");
-    printKnapsackSolution(actual);
-    printf("\n");
-    printf("Expected:\n");
-    printKnapsackSolution(expected);
+// Binary item files are this header and then count Items for knapsack, or
+// count int64_t elements for subset sum, in host byte order. They load
+// with a single copy and no parsing.
+#define ITEM_FILE_MAGIC "KNAPITEM"
+#define ITEM_FILE_KNAPSACK 1
+#define ITEM_FILE_SUBSET_SUM 2
+#define ITEM_FILE_KNAPSACK64 3
+
+typedef struct {
+  char magic[8];
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t count;
+} ItemFileHeader;
+
+// The payload of a binary item file of the given kind, or NULL if source
+// is text. Exits if it is an item file of the wrong kind or cut short.
+const void *itemFilePayload(Source source, uint32_t kind, size_t item_size,
+                            int *n) {
+  ItemFileHeader header;
+  if (source.length < sizeof(header) ||
+      memcmp(source.text, ITEM_FILE_MAGIC, sizeof(header.magic)) != 0) {
+    return NULL;
+  }
 
-    exit(1);
+  memcpy(&header, source.text, sizeof(header));
+  if (header.kind != kind) {
+    fprintf(stderr, "Error: The item file holds the other problem\n");
+    exit(EXIT_FAILURE);
+  }
+  if (header.count > INT_MAX ||
+      (source.length - sizeof(header)) / item_size < header.count) {
+    fprintf(stderr, "Error: The item file is truncated\n");
+    exit(EXIT_FAILURE);
   }
+
+  *n = (int)header.count;
+  return source.text + sizeof(header);
 }
 
-void checkSubsetSumSolution(SubsetSumSolution actual,
-                            SubsetSumSolution expected) {
-  if (!testSubsetSumSolutionEqual(actual, expected)) {
-    printf("Test failed!\n");
-    printf("\n");
-    printf("Actual:\n");
-    printSubsetSumSolution(actual);
-    printf("\n");
-    printf("Expected:\n");
-    printSubsetSumSolution(expected);
+bool writeItemFile(const char *path, uint32_t kind, const void *items,
+                   int n, size_t item_size) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Cannot create '%s'\n", path);
+    return false;
+  }
 
-    exit(1);
+  ItemFileHeader header = {.kind = kind, .reserved = 0, .count = n};
+  memcpy(header.magic, ITEM_FILE_MAGIC, sizeof(header.magic));
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(items, item_size, n, file) == (size_t)n;
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "Error: Cannot write '%s'\n", path);
   }
+  return ok;
 }
 
-int main() {
-  // Test case 1
-  {
-    int capacity = 50;
-    Item items[] = {{10, 60}, {20, 100}, {30, 30}};
-    int n = sizeof(items) / sizeof(items[0]);
-
-    KnapsackSolution expected = {.selected = (Item[]){items[0], items[1]},
-                                 .n = 2,
-                                 .value = 160,
-                                 .remaining_capacity = 20};
+// The integers of a text source, or NULL after reporting the bad input
+int64_t *readIntegers(Source source, int threads, long long *count) {
+  int64_t *values;
+  size_t error;
+  *count = parseIntegers(source.text, source.length, threads, &values, &error);
+  if (*count < 0) {
+    fprintf(stderr, "Invalid input format at byte %zu\n", error);
+    return NULL;
+  }
+  if (*count > INT_MAX) {
+    fprintf(stderr, "Too many items\n");
+    free(values);
+    return NULL;
+  }
+  return values;
+}
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    checkKnapsackSolution(solution, expected);
+// Knapsack items as <weight> <value> pairs of ints, from text or a binary
+// item file
+Item *readItems(Source source, int threads, int *n) {
+  const void *payload =
+      itemFilePayload(source, ITEM_FILE_KNAPSACK, sizeof(Item), n);
+  if (payload != NULL) {
+    Item *items = (Item *)malloc((*n > 0 ? *n : 1) * sizeof(Item));
+    memcpy(items, payload, (size_t)*n * sizeof(Item));
+    return items;
+  }
 
-    free(solution.selected);
+  long long count;
+  int64_t *values = readIntegers(source, threads, &count);
+  if (values == NULL) {
+    return NULL;
+  }
+  if (count % 2 != 0) {
+    fprintf(stderr, "Invalid input format: odd number of integers\n");
+    free(values);
+    return NULL;
   }
 
-  // Test case 2
-  {
-    int capacity = 0;
-    Item items[] = {{10, 60}, {20, 100}, {30, 30}};
-    int n = sizeof(items) / sizeof(items[0]);
+  *n = (int)(count / 2);
+  Item *items = (Item *)malloc((*n > 0 ? *n : 1) * sizeof(Item));
+  for (int i = 0; i < *n; i++) {
+    int64_t weight = values[2 * i];
+    int64_t value = values[2 * i + 1];
+    if (weight < INT_MIN || weight > INT_MAX || value < INT_MIN ||
+        value > INT_MAX) {
+      fprintf(stderr,
+              "Invalid input format: item %d is out of range, try -w\n",
+              i + 1);
+      free(values);
+      free(items);
+      return NULL;
+    }
+    items[i] = (Item){.weight = (int)weight, .value = (int)value};
+  }
 
-    KnapsackSolution expected = {
-        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 0};
+  free(values);
+  return items;
+}
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    checkKnapsackSolution(solution, expected);
+// Knapsack items as pairs of 64-bit integers, from text or a binary item
+// file
+Item64 *readItems64(Source source, int threads, int *n) {
+  const void *payload =
+      itemFilePayload(source, ITEM_FILE_KNAPSACK64, sizeof(Item64), n);
+  if (payload != NULL) {
+    Item64 *items = (Item64 *)malloc((*n > 0 ? *n : 1) * sizeof(Item64));
+    memcpy(items, payload, (size_t)*n * sizeof(Item64));
+    return items;
+  }
 
-    free(solution.selected);
+  long long count;
+  int64_t *values = readIntegers(source, threads, &count);
+  if (values == NULL) {
+    return NULL;
+  }
+  if (count % 2 != 0) {
+    fprintf(stderr, "Invalid input format: odd number of integers\n");
+    free(values);
+    return NULL;
   }
 
-  // Test case 3
-  {
-    int capacity = 50;
-    Item items[] = {};
-    int n = sizeof(items) / sizeof(items[0]);
+  // Item64 is two int64_t, laid out as the pairs already are
+  *n = (int)(count / 2);
+  return (Item64 *)values;
+}
 
-    KnapsackSolution expected = {
-        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 50};
+// Solves each capacity with the int64_t table, for values past int
+int solveKnapsack64(Item64 items[], int n, const long long capacities[],
+                    int count, bool valueOnly) {
+  for (int c = 0; c < count; c++) {
+    int current = (int)capacities[c];
+    if (count > 1) {
+      printf("%sCapacity = %d\n", c > 0 ? "\n" : "", current);
+    }
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    checkKnapsackSolution(solution, expected);
+    // The value alone needs only the row, not the table to trace back
+    if (valueOnly) {
+      int64_t value = knapsackValue64(items, n, current);
+      if (value < 0) {
+        fprintf(stderr, "Error: The item values can overflow 64 bits\n");
+        return 1;
+      }
+      printf("Maximum value in knapsack = %" PRId64 "\n", value);
+      continue;
+    }
+
+    KnapsackSolution64 solution = knapsack64(items, n, current);
+    if (solution.overflow) {
+      fprintf(stderr, "Error: The item values can overflow 64 bits\n");
+      return 1;
+    }
+    printKnapsackSolution64(solution);
 
     free(solution.selected);
   }
+  return 0;
+}
 
-  // Test case 4
-  {
-    int capacity = 50;
-    Item items[] = {{60, 100}, {100, 200}, {120, 300}};
-    int n = sizeof(items) / sizeof(items[0]);
+// Bounded items as <weight> <value> <count> triples of ints
+BoundedItem *readBoundedItems(Source source, int threads, int *n) {
+  long long count;
+  int64_t *values = readIntegers(source, threads, &count);
+  if (values == NULL) {
+    return NULL;
+  }
+  if (count % 3 != 0) {
+    fprintf(stderr, "Invalid input format: expected triples\n");
+    free(values);
+    return NULL;
+  }
 
-    KnapsackSolution expected = {
-        .selected = (Item[]){}, .n = 0, .value = 0, .remaining_capacity = 50};
+  *n = (int)(count / 3);
+  BoundedItem *items =
+      (BoundedItem *)malloc((*n > 0 ? *n : 1) * sizeof(BoundedItem));
+  for (int i = 0; i < *n; i++) {
+    const int64_t *triple = values + 3 * (size_t)i;
+    for (int k = 0; k < 3; k++) {
+      if (triple[k] < INT_MIN || triple[k] > INT_MAX) {
+        fprintf(stderr, "Invalid input format: item %d is out of range\n",
+                i + 1);
+        free(values);
+        free(items);
+        return NULL;
+      }
+    }
+    items[i] = (BoundedItem){.weight = (int)triple[0],
+                             .value = (int)triple[1],
+                             .count = (int)triple[2]};
+  }
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    checkKnapsackSolution(solution, expected);
+  free(values);
+  return items;
+}
 
-    free(solution.selected);
+// Solves the bounded (triples) or unbounded (pairs) variant at each
+// capacity
+int solveWithCopies(Source source, int threads, bool bounded,
+                    const long long capacities[], int count,
+                    bool valueOnly) {
+  int n = 0;
+  BoundedItem *bounded_items = NULL;
+  Item *items = NULL;
+  if (bounded) {
+    bounded_items = readBoundedItems(source, threads, &n);
+    if (bounded_items != NULL) {
+      items = (Item *)malloc((n > 0 ? n : 1) * sizeof(Item));
+      for (int i = 0; i < n; i++) {
+        items[i] = (Item){.weight = bounded_items[i].weight,
+                          .value = bounded_items[i].value};
+      }
+    }
+  } else {
+    items = readItems(source, threads, &n);
+  }
+  if (items == NULL) {
+    return 1;
   }
 
-  // Test case 5
-  {
-    int capacity = 50;
-    Item items[] = {{10, 60}, {20, 100}, {30, 120}};
-    int n = sizeof(items) / sizeof(items[0]);
-
-    KnapsackSolution expected = {.selected = (Item[]){items[1], items[2]},
-                                 .n = 2,
-                                 .value = 220,
-                                 .remaining_capacity = 0};
+  int status = 0;
+  for (int c = 0; c < count && status == 0; c++) {
+    int current = (int)capacities[c];
+    if (count > 1) {
+      printf("%sCapacity = %d\n", c > 0 ? "\n" : "", current);
+    }
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    checkKnapsackSolution(solution, expected);
+    BoundedSolution solution =
+        bounded ? knapsackBounded(bounded_items, n, current)
+                : knapsackUnbounded(items, n, current);
+    if (solution.overflow) {
+      fprintf(stderr, "Error: The best value can overflow an int\n");
+      status = 1;
+    } else if (valueOnly) {
+      printf("Maximum value in knapsack = %d\n", solution.value);
+    } else {
+      printBoundedSolution(solution, items);
+    }
 
-    free(solution.selected);
+    free(solution.counts);
   }
 
-  // Test case 6
-  {
-    int capacity = 9;
-    int set[] = {1, 2, 3, 4, 5};
-    int n = sizeof(set) / sizeof(set[0]);
+  free(bounded_items);
+  free(items);
+  return status;
+}
 
-    SubsetSumSolution expected = {.selected = (int[]){set[1], set[2], set[3]},
-                                  .n = 3,
-                                  .value = 9,
-                                  .remaining_capacity = 0};
+// Subset sum elements, from text or a binary item file
+int64_t *readElements(Source source, int threads, int *n) {
+  const void *payload =
+      itemFilePayload(source, ITEM_FILE_SUBSET_SUM, sizeof(int64_t), n);
+  if (payload != NULL) {
+    int64_t *set = (int64_t *)malloc((*n > 0 ? *n : 1) * sizeof(int64_t));
+    memcpy(set, payload, (size_t)*n * sizeof(int64_t));
+    return set;
+  }
 
-    SubsetSumSolution solution = subsetSum(set, n, capacity);
-    checkSubsetSumSolution(solution, expected);
+  long long count;
+  int64_t *set = readIntegers(source, threads, &count);
+  *n = (int)count;
+  return set;
+}
 
-    free(solution.selected);
+// Bytes the table engine needs, one bit per cell plus the rolling row of
+// values of valueBytes each, or only the row for the value
+double tableBytes(int n, int capacity, bool valueOnly, size_t valueBytes) {
+  double row = (capacity + 1.0) * valueBytes;
+  if (valueOnly) {
+    return row;
   }
+  return row + (double)n * bitsetWords(capacity + 1) * sizeof(uint64_t);
+}
 
-  printf("All test cases passed!\n");
+// A comma separated list of capacities, or NULL if it isn't one
+long long *parseCapacities(const char *text, int *count) {
+  int size = 1;
+  for (const char *c = text; *c != '\0'; c++) {
+    size += *c == ',';
+  }
+
+  long long *capacities = (long long *)malloc(size * sizeof(long long));
+  *count = 0;
+  while (true) {
+    char *end;
+    capacities[(*count)++] = strtoll(text, &end, 10);
+    if (end == text || (*end != ',' && *end != '\0')) {
+      free(capacities);
+      return NULL;
+    }
+    if (*end == '\0') {
+      return capacities;
+    }
+    text = end + 1;
+  }
 }
 
-#else
 void usage(char *name) {
   printf("Usage: %s [options]\n", name);
   printf("\n");
   printf("Options:\n");
   printf("  -h, --help                 Show this help message\n");
   printf("  -c, --capacity <capacity>  Set the capacity of the knapsack\n");
+  printf("                             A comma separated list solves the\n");
+  printf("                             knapsack at each, from one table\n");
   printf("  -s, --subset-sum           Solve the subset sum problem\n");
   printf("  -k, --knapsack             Solve the knapsack problem (default)\n");
+  printf("  -v, --value-only           Print only the best value, in\n");
+  printf("                             O(capacity) memory\n");
+  printf("  -e, --engine <engine>      Knapsack engine, auto by default:\n");
+  printf("                             auto        table if it fits the\n");
+  printf("                                         memory budget, else bnb\n");
+  printf("                             table       one bit per cell\n");
+  printf("                             hirschberg  O(n + capacity) memory\n");
+  printf("                             bnb         branch and bound, for\n");
+  printf("                                         huge capacities\n");
+  printf("                             mitm        meet in the middle, for\n");
+  printf("                                         subset sum with up to\n");
+  printf("                                         64 elements of 64 bits\n");
+  printf("  -m, --memory <MiB>         Memory budget of the auto engine,\n");
+  printf("                             1024 by default\n");
+  printf("  -n, --no-reduction         Search every item in branch and\n");
+  printf("                             bound, without fixing any first\n");
+  printf("  -t, --threads <threads>    Split the table engine's rows and\n");
+  printf("                             the input parsing across threads, 0\n");
+  printf("                             for every core\n");
+  printf("  -b, --bounded              Items may be taken up to a count of\n");
+  printf("                             times, read as a third number\n");
+  printf("  -u, --unbounded            Items may be taken any number of\n");
+  printf("                             times\n");
+  printf("  -w, --wide                 64-bit weights and values for the\n");
+  printf("                             table engine, picked automatically\n");
+  printf("                             when int values could overflow\n");
+  printf("  -S, --stats                Print the time taken and the peak\n");
+  printf("                             memory to stderr\n");
+  printf("  -i, --input <file>         Read the items from a file, text or\n");
+  printf("                             binary, instead of stdin\n");
+  printf("  -o, --output-binary <file> Write the items as a binary item\n");
+  printf("                             file and exit\n");
   printf("\n");
   printf("Input line format:\n");
   printf("  For subset sum: <item_weight>\n");
   printf("  For knapsack: <item_weight> <item_value>\n");
+  printf("  For bounded knapsack: <item_weight> <item_value> <item_count>\n");
+  printf("\n");
+  printf("Binary item files start with the 8 bytes KNAPITEM, a 32-bit kind\n");
+  printf("(1 knapsack, 2 subset sum, 3 wide knapsack), 4 zero bytes and a\n");
+  printf("64-bit count, then hold the count items as weight and value pairs\n");
+  printf("of 32 bits, 64-bit elements or pairs of 64 bits, in host byte\n");
+  printf("order.\n");
   printf("\n");
 }
 
 int main(int argc, char *argv[]) {
-  int capacity = 0;
+  startSeconds = nowSeconds();
+  long long capacity = 0;
+  long long *capacities = NULL;
+  int capacityCount = 1;
   bool subsetSumFlag = false;
+  bool valueOnlyFlag = false;
+  const char *engine = "auto";
+  int threads = 1;
+  double memoryBudget = 1024;
+  bool reduceFlag = true;
+  bool wideFlag = false;
+  bool boundedFlag = false;
+  bool unboundedFlag = false;
+  const char *inputPath = NULL;
+  const char *binaryPath = NULL;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
@@ -355,7 +3244,19 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(argv[i], "-c") == 0 ||
                strcmp(argv[i], "--capacity") == 0) {
       if (i + 1 < argc) {
-        capacity = atoi(argv[++i]);
+        free(capacities);
+        capacities = parseCapacities(argv[++i], &capacityCount);
+        if (capacities == NULL) {
+          fprintf(stderr, "Error: Invalid capacity '%s'\n", argv[i]);
+          return 1;
+        }
+
+        capacity = capacities[0];
+        for (int c = 1; c < capacityCount; c++) {
+          if (capacities[c] > capacity) {
+            capacity = capacities[c];
+          }
+        }
       } else {
         fprintf(stderr, "Error: Missing capacity value\n");
         return 1;
@@ -366,73 +3267,316 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(argv[i], "-k") == 0 ||
                strcmp(argv[i], "--knapsack") == 0) {
       subsetSumFlag = false;
+    } else if (strcmp(argv[i], "-v") == 0 ||
+               strcmp(argv[i], "--value-only") == 0) {
+      valueOnlyFlag = true;
+    } else if (strcmp(argv[i], "-t") == 0 ||
+               strcmp(argv[i], "--threads") == 0) {
+      if (i + 1 < argc) {
+        threads = atoi(argv[++i]);
+      } else {
+        fprintf(stderr, "Error: Missing thread count\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-m") == 0 ||
+               strcmp(argv[i], "--memory") == 0) {
+      if (i + 1 < argc) {
+        memoryBudget = atof(argv[++i]);
+      } else {
+        fprintf(stderr, "Error: Missing memory budget\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-S") == 0 ||
+               strcmp(argv[i], "--stats") == 0) {
+      atexit(printStats);
+    } else if (strcmp(argv[i], "-b") == 0 ||
+               strcmp(argv[i], "--bounded") == 0) {
+      boundedFlag = true;
+      unboundedFlag = false;
+    } else if (strcmp(argv[i], "-u") == 0 ||
+               strcmp(argv[i], "--unbounded") == 0) {
+      unboundedFlag = true;
+      boundedFlag = false;
+    } else if (strcmp(argv[i], "-w") == 0 ||
+               strcmp(argv[i], "--wide") == 0) {
+      wideFlag = true;
+    } else if (strcmp(argv[i], "-i") == 0 ||
+               strcmp(argv[i], "--input") == 0) {
+      if (i + 1 < argc) {
+        inputPath = argv[++i];
+      } else {
+        fprintf(stderr, "Error: Missing input file\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-o") == 0 ||
+               strcmp(argv[i], "--output-binary") == 0) {
+      if (i + 1 < argc) {
+        binaryPath = argv[++i];
+      } else {
+        fprintf(stderr, "Error: Missing output file\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-n") == 0 ||
+               strcmp(argv[i], "--no-reduction") == 0) {
+      reduceFlag = false;
+    } else if (strcmp(argv[i], "-e") == 0 ||
+               strcmp(argv[i], "--engine") == 0) {
+      if (i + 1 < argc) {
+        engine = argv[++i];
+      } else {
+        fprintf(stderr, "Error: Missing engine name\n");
+        return 1;
+      }
     } else {
       fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
       return 1;
     }
   }
 
+  if (strcmp(engine, "auto") != 0 && strcmp(engine, "table") != 0 &&
+      strcmp(engine, "hirschberg") != 0 && strcmp(engine, "bnb") != 0 &&
+      strcmp(engine, "mitm") != 0) {
+    fprintf(stderr, "Error: Unknown engine '%s'\n", engine);
+    return 1;
+  }
+
+  if (capacityCount > 1 && subsetSumFlag) {
+    fprintf(stderr, "Error: Lists of capacities only work for knapsack\n");
+    return 1;
+  }
+  if (capacities == NULL) {
+    capacities = (long long *)calloc(1, sizeof(long long));
+  }
+
+  Source source = openSource(inputPath);
+
   if (subsetSumFlag) {
     int n = 0;
-    int items_size = 100;
-    int *items = malloc(items_size * sizeof(int));
+    int64_t *items = readElements(source, threads, &n);
+    closeSource(source);
+    if (items == NULL) {
+      return 1;
+    }
+
+    if (binaryPath != NULL) {
+      bool ok = writeItemFile(binaryPath, ITEM_FILE_SUBSET_SUM, items, n,
+                              sizeof(int64_t));
+      free(items);
+      return ok ? 0 : 1;
+    }
 
-    while (true) {
-      int item;
-      int r = scanf("%d", &item);
-      if (r == EOF) {
-        break;
+    // The bitset takes a bit and an int per sum, meet in the middle only
+    // works for a few dozen elements
+    if (strcmp(engine, "auto") == 0) {
+      double bytes = (capacity + 1.0) * (sizeof(int) + 1.0 / 8);
+      engine = (capacity > INT_MAX || bytes > memoryBudget * 1024 * 1024) &&
+                       n <= MITM_MAX_ELEMENTS
+                   ? "mitm"
+                   : "table";
+    }
+
+    if (strcmp(engine, "mitm") == 0) {
+      SubsetSumSolution64 solution =
+          subsetSumMeetInTheMiddle(items, n, capacity);
+      if (valueOnlyFlag) {
+        printf("Maximum value in subset sum = %" PRId64 "\n", solution.value);
+      } else {
+        printSubsetSumSolution64(solution);
       }
 
-      if (r != 1) {
-        fprintf(stderr, "Invalid input format\n");
-        free(items);
+      free(solution.selected);
+      free(items);
+      return 0;
+    }
+
+    if (capacity > INT_MAX) {
+      fprintf(stderr, "Error: Capacity too large for the bitset, use mitm\n");
+      free(items);
+      return 1;
+    }
+
+    // Elements past capacity are skipped either way, and so are those that
+    // add nothing, which may not fit an int
+    int *set = malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+      set[i] = items[i] <= 0 || items[i] > capacity ? -1 : (int)items[i];
+    }
+
+    if (valueOnlyFlag) {
+      printf("Maximum value in subset sum = %d\n",
+             subsetSumValue(set, n, capacity));
+    } else {
+      SubsetSumSolution solution = subsetSum(set, n, capacity);
+      printSubsetSumSolution(solution);
+
+      free(solution.selected);
+    }
+
+    free(set);
+  } else {
+    if (strcmp(engine, "mitm") == 0) {
+      fprintf(stderr, "Error: The mitm engine only solves subset sum\n");
+      return 1;
+    }
+    if (capacity > INT_MAX) {
+      fprintf(stderr, "Error: Capacity must fit in an int\n");
+      return 1;
+    }
+
+    // Copies of an item run through their own tables, so only the table
+    // engine and the int values apply
+    if (boundedFlag || unboundedFlag) {
+      if ((strcmp(engine, "auto") != 0 && strcmp(engine, "table") != 0) ||
+          wideFlag || binaryPath != NULL) {
+        fprintf(stderr, "Error: -b and -u only run the table engine, "
+                        "without -w or -o\n");
         return 1;
       }
 
-      if (n >= items_size) {
-        items_size *= 2;
-        items = realloc(items, items_size * sizeof(int));
+      int status = solveWithCopies(source, threads, boundedFlag, capacities,
+                                   capacityCount, valueOnlyFlag);
+      closeSource(source);
+      free(capacities);
+      return status;
+    }
+
+    // The auto engine only falls back to bnb for int values, so a 64-bit
+    // table past the budget is an error instead
+    bool automatic = strcmp(engine, "auto") == 0;
+    double budget = memoryBudget * 1024 * 1024;
+
+    int n = 0;
+    if (wideFlag) {
+      Item64 *items = readItems64(source, threads, &n);
+      closeSource(source);
+      if (items == NULL) {
+        return 1;
       }
 
-      items[n++] = item;
+      int status = 0;
+      if (binaryPath != NULL) {
+        status = writeItemFile(binaryPath, ITEM_FILE_KNAPSACK64, items, n,
+                               sizeof(Item64))
+                     ? 0
+                     : 1;
+      } else if (strcmp(engine, "auto") != 0 &&
+                 strcmp(engine, "table") != 0) {
+        fprintf(stderr, "Error: Only the table engine takes -w\n");
+        status = 1;
+      } else if (automatic &&
+                 tableBytes(n, capacity, valueOnlyFlag, sizeof(int64_t)) >
+                     budget) {
+        fprintf(stderr, "Error: The 64-bit table doesn't fit the memory "
+                        "budget\n");
+        status = 1;
+      } else {
+        status = solveKnapsack64(items, n, capacities, capacityCount,
+                                 valueOnlyFlag);
+      }
+      free(items);
+      free(capacities);
+      return status;
     }
 
-    SubsetSumSolution solution = subsetSum(items, n, capacity);
-    printSubsetSumSolution(solution);
+    Item *items = readItems(source, threads, &n);
+    closeSource(source);
+    if (items == NULL) {
+      return 1;
+    }
 
-    free(solution.selected);
-  } else {
-    int n = 0;
+    if (binaryPath != NULL) {
+      bool ok = writeItemFile(binaryPath, ITEM_FILE_KNAPSACK, items, n,
+                              sizeof(Item));
+      free(items);
+      return ok ? 0 : 1;
+    }
 
-    int items_size = 100;
-    Item *items = malloc(items_size * sizeof(Item));
+    if (automatic) {
+      engine = tableBytes(n, capacity, valueOnlyFlag, sizeof(int)) > budget
+                   ? "bnb"
+                   : "table";
+    }
 
-    while (true) {
-      Item item;
-      int r = scanf("%d %d", &item.weight, &item.value);
-      if (r == EOF) {
-        break;
+    // Values whose sum overflows an int move to the int64_t table
+    if (!knapsackValuesFit(items, n)) {
+      if (automatic &&
+          tableBytes(n, capacity, valueOnlyFlag, sizeof(int64_t)) > budget) {
+        fprintf(stderr, "Error: The item values can overflow an int, and "
+                        "the 64-bit table doesn't fit the memory budget\n");
+        return 1;
       }
-
-      if (r != 2) {
-        fprintf(stderr, "Invalid input format\n");
-        free(items);
+      if (strcmp(engine, "table") != 0) {
+        fprintf(stderr, "Error: The item values can overflow an int, and "
+                        "only the table engine takes 64 bits\n");
         return 1;
       }
 
-      if (n >= items_size) {
-        items_size *= 2;
-        items = realloc(items, items_size * sizeof(Item));
+      Item64 *wide = (Item64 *)malloc((n > 0 ? n : 1) * sizeof(Item64));
+      for (int i = 0; i < n; i++) {
+        wide[i] = (Item64){.weight = items[i].weight,
+                           .value = items[i].value};
       }
+      int status = solveKnapsack64(wide, n, capacities, capacityCount,
+                                   valueOnlyFlag);
+      free(wide);
+      free(items);
+      free(capacities);
+      return status;
+    }
 
-      items[n++] = item;
+    // The table engine answers every capacity from one pass: the last row
+    // for values, or one table for the largest capacity to trace back from
+    bool bnb = strcmp(engine, "bnb") == 0;
+    bool hirschberg = strcmp(engine, "hirschberg") == 0;
+    int *best = NULL;
+    KnapsackSolution *solutions = NULL;
+    if (valueOnlyFlag && !bnb) {
+      best = knapsackValues(items, n, capacity, threads);
+    } else if (!bnb && !hirschberg && capacityCount > 1) {
+      int *table_capacities = (int *)malloc(capacityCount * sizeof(int));
+      for (int c = 0; c < capacityCount; c++) {
+        table_capacities[c] = (int)capacities[c];
+      }
+      solutions = knapsackBatch(items, n, table_capacities, capacityCount,
+                                threads);
+      free(table_capacities);
     }
 
-    KnapsackSolution solution = knapsack(items, n, capacity);
-    printKnapsackSolution(solution);
+    for (int c = 0; c < capacityCount; c++) {
+      int current = (int)capacities[c];
+      if (capacityCount > 1) {
+        printf("%sCapacity = %d\n", c > 0 ? "\n" : "", current);
+      }
 
-    free(solution.selected);
+      if (best != NULL) {
+        printf("Maximum value in knapsack = %d\n",
+               current > 0 ? best[current] : 0);
+        continue;
+      }
+
+      KnapsackSolution solution;
+      if (solutions != NULL) {
+        solution = solutions[c];
+      } else if (bnb) {
+        solution = knapsackBranchAndBound(items, n, current, reduceFlag);
+      } else if (hirschberg) {
+        solution = knapsackHirschberg(items, n, current);
+      } else {
+        solution = knapsackParallel(items, n, current, threads);
+      }
+      if (valueOnlyFlag) {
+        printf("Maximum value in knapsack = %d\n", solution.value);
+      } else {
+        printKnapsackSolution(solution);
+      }
+
+      free(solution.selected);
+    }
+
+    free(best);
+    free(solutions);
   }
+
+  free(capacities);
 }
 #endif
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+gcc -O2 generate-sample-input.c -o generate-sample-input && \
+  ./generate-sample-input
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// The standard hard instance classes for knapsack (Pisinger), with weights
+// uniform in [1, range]:
+//
+//   uncorrelated         values uniform in [1, range]
+//   weakly-correlated    values within range / 10 of the weight
+//   strongly-correlated  values = weight + range / 10
+//   subset-sum           values = weight
+//
+// The capacity is half the total weight, which keeps about half the items
+// in the knapsack and the instances hard for every engine.
+const char *classes[] = {"uncorrelated", "weakly-correlated",
+                         "strongly-correlated", "subset-sum"};
+
+unsigned long long state = 1;
+
+// xorshift64*, so instances are the same on every platform
+long long random_below(long long bound) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return (long long)((state * 2685821657736338717ULL) >> 11) % bound;
+}
+
+// Writes n items of the class as "<weight> <value>" lines and returns the
+// capacity, or -1 for an unknown class
+long long generate_items(FILE *file, const char *class, int n, long long range,
+                         unsigned long long seed) {
+  state = seed * 0x9E3779B97F4A7C15ULL | 1;
+
+  long long total = 0;
+  for (int i = 0; i < n; i++) {
+    long long weight = 1 + random_below(range);
+    long long value;
+    if (strcmp(class, "uncorrelated") == 0) {
+      value = 1 + random_below(range);
+    } else if (strcmp(class, "weakly-correlated") == 0) {
+      long long spread = range / 10 > 0 ? range / 10 : 1;
+      value = weight - spread + random_below(2 * spread + 1);
+      if (value < 1) {
+        value = 1;
+      }
+    } else if (strcmp(class, "strongly-correlated") == 0) {
+      value = weight + range / 10;
+    } else if (strcmp(class, "subset-sum") == 0) {
+      value = weight;
+    } else {
+      return -1;
+    }
+
+    fprintf(file, "%lld %lld\n", weight, value);
+    total += weight;
+  }
+
+  return total / 2;
+}
+
+// Writes one instance to hard/ and adds it to the index
+void generate_file(FILE *index, const char *class, int n, long long range,
+                   unsigned long long seed) {
+  char filename[256];
+  snprintf(filename, sizeof(filename), "%s-%d-%lld.txt", class, n, range);
+
+  char path[300];
+  snprintf(path, sizeof(path), "hard/%s", filename);
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    perror("Error opening file");
+    return;
+  }
+
+  fprintf(index, "%s %lld\n", filename,
+          generate_items(file, class, n, range, seed));
+  fclose(file);
+}
+
+// Every class at a few sizes, written to hard/ with an index of file names
+// and capacities for benchmark.sh. The last size has capacities too large
+// for a table, and a subset sum instance with 40-bit weights is only
+// within reach of meet in the middle.
+void generate_suite() {
+  int sizes[] = {100, 1000, 5000, 100};
+  long long ranges[] = {1000, 1000, 1000, 10000000};
+
+  mkdir("hard", 0755);
+  FILE *index = fopen("hard/index.txt", "w");
+  if (index == NULL) {
+    perror("Error opening file");
+    return;
+  }
+
+  for (int c = 0; c < 4; c++) {
+    for (int s = 0; s < 4; s++) {
+      generate_file(index, classes[c], sizes[s], ranges[s], 10 * c + s + 1);
+    }
+  }
+  generate_file(index, "subset-sum", 40, 1000000000000, 50);
+
+  fclose(index);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 1) {
+    generate_suite();
+    return 0;
+  }
+
+  if (argc < 4 || argc > 5) {
+    fprintf(stderr, "Usage: %s [<class> <n> <range> [seed]]\n", argv[0]);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Writes n items to stdout and their capacity to stderr.\n");
+    fprintf(stderr, "Without arguments, writes the suite to hard/.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Classes: uncorrelated, weakly-correlated,\n");
+    fprintf(stderr, "         strongly-correlated, subset-sum\n");
+    return 1;
+  }
+
+  int n = atoi(argv[2]);
+  long long range = atoll(argv[3]);
+  unsigned long long seed = argc == 5 ? strtoull(argv[4], NULL, 10) : 1;
+  if (n < 0 || range < 1) {
+    fprintf(stderr, "Error: n must be at least 0 and range at least 1\n");
+    return 1;
+  }
+
+  long long capacity = generate_items(stdout, argv[1], n, range, seed);
+  if (capacity < 0) {
+    fprintf(stderr, "Error: Unknown class '%s'\n", argv[1]);
+    return 1;
+  }
+  fprintf(stderr, "%lld\n", capacity);
+}
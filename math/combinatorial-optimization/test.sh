@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Runs the unit tests, then checks the first line the CLI prints for inputs
+# that only go wrong between reading the input and calling the library.
+#
+# Usage: ./test.sh
+
+./build.sh || exit 1
+build/test || exit 1
+
+failed=0
+
+# check <input> <expected first line> <options>...
+check() {
+  local input=$1
+  local expected=$2
+  shift 2
+  local actual
+  actual=$(echo "$input" | build/knapsack "$@" 2>&1 | head -n 1)
+  if [ "$actual" != "$expected" ]; then
+    echo "CLI test failed: knapsack $* <<< '$input'"
+    echo "  expected: $expected"
+    echo "  actual:   $actual"
+    failed=1
+  fi
+}
+
+# Elements below INT_MIN used to wrap to a positive int
+check "-4294967291 1 2" "Maximum value in subset sum = 3" -s -c 5
+check "-4294967291 1 2" "Maximum value in subset sum = 3" -s -v -c 5
+check "-4294967291 1 2" "Maximum value in subset sum = 3" -s -e mitm -c 5
+
+if [ $failed -ne 0 ]; then
+  exit 1
+fi
+echo "All CLI tests passed!"
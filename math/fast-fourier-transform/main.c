@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -8,43 +9,364 @@ typedef struct {
   double imag;
 } Complex;
 
-void fft(Complex *X, int n) {
+// Plan flags, as in FFTW: the sign of the exponent, and no scaling either
+// way, so an inverse of a forward transform multiplies by n
+#define FFT_FORWARD 0
+#define FFT_INVERSE 1
+
+// Everything a transform of one size needs, so executing a plan never
+// calls cos or sin or allocates. The scratch buffers make executing one
+// plan from two threads at once unsafe; give each thread its own.
+typedef struct FftPlan {
+  int n;
+  int flags;
+  // e^(-2 pi i k / n) for k < n
+  Complex *twiddles;
+  // Where each index goes in the bit-reversal permutation, for a power of
+  // two
+  int *bitrev;
+  // Radices of a size made of 2, 3, 5 and 7, largest powers of 4 first
+  int factors[32];
+  int factor_count;
+  Complex *scratch;
+  // Bluestein's convolution length, 0 when not needed, the chirp
+  // e^(-pi i k^2 / n), the transform of its conjugate padded to m, room
+  // for the convolution and the plan that computes it
+  int m;
+  Complex *chirp;
+  Complex *filter;
+  Complex *work;
+  struct FftPlan *convolution;
+} FftPlan;
+
+void fft_execute(const FftPlan *plan, const Complex *in, Complex *out);
+
+FftPlan *fft_plan_create(int n, int flags) {
+  FftPlan *plan = (FftPlan *)calloc(1, sizeof(FftPlan));
+  plan->n = n;
+  plan->flags = flags;
   if (n <= 1) {
+    return plan;
+  }
+
+  plan->twiddles = (Complex *)malloc(n * sizeof(Complex));
+  for (int k = 0; k < n; k++) {
+    double angle = -2 * M_PI * k / n;
+    plan->twiddles[k] = (Complex){cos(angle), sin(angle)};
+  }
+
+  if ((n & (n - 1)) == 0) {
+    plan->bitrev = (int *)malloc(n * sizeof(int));
+    plan->bitrev[0] = 0;
+    for (int i = 1, j = 0; i < n; i++) {
+      int bit = n >> 1;
+      for (; j & bit; bit >>= 1) {
+        j ^= bit;
+      }
+      j |= bit;
+      plan->bitrev[i] = j;
+    }
+    return plan;
+  }
+
+  int radices[] = {4, 2, 3, 5, 7};
+  int left = n;
+  for (int r = 0; r < 5; r++) {
+    while (left % radices[r] == 0) {
+      plan->factors[plan->factor_count++] = radices[r];
+      left /= radices[r];
+    }
+  }
+
+  if (left == 1) {
+    plan->scratch = (Complex *)malloc(n * sizeof(Complex));
+    return plan;
+  }
+
+  // A prime factor past 7: a convolution of length m >= 2n - 1, done
+  // with power of two transforms
+  plan->factor_count = 0;
+  plan->m = 1;
+  while (plan->m < 2 * n - 1) {
+    plan->m *= 2;
+  }
+  plan->chirp = (Complex *)malloc(n * sizeof(Complex));
+  plan->filter = (Complex *)calloc(plan->m, sizeof(Complex));
+  plan->work = (Complex *)malloc(plan->m * sizeof(Complex));
+  plan->convolution = fft_plan_create(plan->m, FFT_FORWARD);
+  for (long long k = 0; k < n; k++) {
+    // k^2 mod 2n keeps the angle small, and so accurate
+    double angle = -M_PI * (double)(k * k % (2LL * n)) / n;
+    plan->chirp[k] = (Complex){cos(angle), sin(angle)};
+  }
+  for (int k = 0; k < n; k++) {
+    Complex conjugate = {plan->chirp[k].real, -plan->chirp[k].imag};
+    plan->filter[k] = conjugate;
+    if (k > 0) {
+      plan->filter[plan->m - k] = conjugate;
+    }
+  }
+  fft_execute(plan->convolution, plan->filter, plan->filter);
+  return plan;
+}
+
+void fft_plan_destroy(FftPlan *plan) {
+  if (plan == NULL) {
     return;
   }
+  free(plan->twiddles);
+  free(plan->bitrev);
+  free(plan->scratch);
+  free(plan->chirp);
+  free(plan->filter);
+  free(plan->work);
+  fft_plan_destroy(plan->convolution);
+  free(plan);
+}
+
+Complex multiply(Complex a, Complex b) {
+  return (Complex){a.real * b.real - a.imag * b.imag,
+                   a.real * b.imag + a.imag * b.real};
+}
+
+// Iterative radix-2 Cooley-Tukey: in is put in bit-reversed order in out,
+// the order the butterflies leave their outputs in, then log2(n) passes of
+// butterflies run in out with twiddles read from the table at a stride of
+// n / length
+void radix2(const FftPlan *plan, const Complex *in, Complex *out) {
+  int n = plan->n;
+  const Complex *w = plan->twiddles;
+  if (in == out) {
+    for (int i = 1; i < n; i++) {
+      int j = plan->bitrev[i];
+      if (i < j) {
+        Complex temp = out[i];
+        out[i] = out[j];
+        out[j] = temp;
+      }
+    }
+  } else {
+    for (int i = 0; i < n; i++) {
+      out[plan->bitrev[i]] = in[i];
+    }
+  }
 
-  Complex *even = (Complex *)malloc(n / 2 * sizeof(Complex));
-  Complex *odd = (Complex *)malloc(n / 2 * sizeof(Complex));
-  for (int i = 0; i < n / 2; i++) {
-    even[i] = X[i * 2];
-    odd[i] = X[i * 2 + 1];
+  for (int length = 2; length <= n; length *= 2) {
+    int half = length / 2;
+    int stride = n / length;
+    for (int start = 0; start < n; start += length) {
+      Complex *a = out + start;
+      Complex *b = out + start + half;
+      for (int k = 0; k < half; k++) {
+        Complex temp = multiply(w[k * stride], b[k]);
+
+        b[k].real = a[k].real - temp.real;
+        b[k].imag = a[k].imag - temp.imag;
+        a[k].real += temp.real;
+        a[k].imag += temp.imag;
+      }
+    }
   }
+}
 
-  fft(even, n / 2);
-  fft(odd, n / 2);
+// Combines p transforms of length m, stored one after another in out, into
+// one of length p * m. stride = n / (p * m) steps through the twiddles of
+// that length.
+void butterfly(Complex *out, int m, int p, int stride, const Complex *w,
+               int n) {
+  Complex s[7];
+  for (int k = 0; k < m; k++) {
+    s[0] = out[k];
+    for (int q = 1; q < p; q++) {
+      s[q] = multiply(out[k + q * m], w[q * k * stride]);
+    }
 
-  for (int k = 0; k < n / 2; k++) {
-    double t = -2 * M_PI * k / n;
-    Complex exp = {cos(t), sin(t)};
-    Complex temp = {exp.real * odd[k].real - exp.imag * odd[k].imag,
-                    exp.real * odd[k].imag + exp.imag * odd[k].real};
+    if (p == 2) {
+      out[k] = (Complex){s[0].real + s[1].real, s[0].imag + s[1].imag};
+      out[k + m] = (Complex){s[0].real - s[1].real, s[0].imag - s[1].imag};
+    } else if (p == 4) {
+      Complex t0 = {s[0].real + s[2].real, s[0].imag + s[2].imag};
+      Complex t1 = {s[0].real - s[2].real, s[0].imag - s[2].imag};
+      Complex t2 = {s[1].real + s[3].real, s[1].imag + s[3].imag};
+      Complex t3 = {s[1].real - s[3].real, s[1].imag - s[3].imag};
+      // e^(-pi i / 2) = -i
+      out[k] = (Complex){t0.real + t2.real, t0.imag + t2.imag};
+      out[k + m] = (Complex){t1.real + t3.imag, t1.imag - t3.real};
+      out[k + 2 * m] = (Complex){t0.real - t2.real, t0.imag - t2.imag};
+      out[k + 3 * m] = (Complex){t1.real - t3.imag, t1.imag + t3.real};
+    } else {
+      // A direct DFT of the p values, with the p-th roots of unity found
+      // in the table every n / p entries
+      for (int r = 0; r < p; r++) {
+        Complex sum = s[0];
+        for (int q = 1; q < p; q++) {
+          Complex term = multiply(s[q], w[q * r % p * (n / p)]);
+          sum.real += term.real;
+          sum.imag += term.imag;
+        }
+        out[k + r * m] = sum;
+      }
+    }
+  }
+}
 
-    X[k].real = even[k].real + temp.real;
-    X[k].imag = even[k].imag + temp.imag;
+// Mixed-radix decimation in time: the p interleaved subsequences of in,
+// stride apart, are transformed into consecutive blocks of out, which a
+// radix-p butterfly then combines
+void mixed_radix(Complex *out, const Complex *in, int length, int stride,
+                 const int *factors, const Complex *w, int n) {
+  int p = factors[0];
+  int m = length / p;
+  if (m == 1) {
+    for (int q = 0; q < p; q++) {
+      out[q] = in[q * stride];
+    }
+  } else {
+    for (int q = 0; q < p; q++) {
+      mixed_radix(out + q * m, in + q * stride, m, stride * p, factors + 1,
+                  w, n);
+    }
+  }
+  butterfly(out, m, p, stride, w, n);
+}
+
+// Bluestein's chirp-z: with jk = (j^2 + k^2 - (k - j)^2) / 2, the DFT is
+// the chirp times a convolution of the chirped input with the conjugate
+// chirp, done with power of two transforms of length m
+void bluestein(const FftPlan *plan, const Complex *in, Complex *out) {
+  int n = plan->n;
+  int m = plan->m;
+  Complex *work = plan->work;
+  for (int k = 0; k < n; k++) {
+    work[k] = multiply(in[k], plan->chirp[k]);
+  }
+  for (int k = n; k < m; k++) {
+    work[k] = (Complex){0, 0};
+  }
 
-    X[k + n / 2].real = even[k].real - temp.real;
-    X[k + n / 2].imag = even[k].imag - temp.imag;
+  fft_execute(plan->convolution, work, work);
+  // The inverse transform is the forward one on the conjugate
+  for (int k = 0; k < m; k++) {
+    work[k] = multiply(work[k], plan->filter[k]);
+    work[k].imag = -work[k].imag;
   }
+  fft_execute(plan->convolution, work, work);
 
-  free(even);
-  free(odd);
+  for (int k = 0; k < n; k++) {
+    Complex product = {work[k].real / m, -work[k].imag / m};
+    out[k] = multiply(product, plan->chirp[k]);
+  }
+}
+
+// Transforms in into out, which may be the same array. Powers of two use
+// the radix-2, sizes made of 2, 3, 5 and 7 the mixed radix, and the rest
+// Bluestein, so every size is O(n log n). The inverse runs the forward
+// transform between two conjugations.
+void fft_execute(const FftPlan *plan, const Complex *in, Complex *out) {
+  int n = plan->n;
+  bool inverse = plan->flags & FFT_INVERSE;
+  if (inverse) {
+    for (int k = 0; k < n; k++) {
+      out[k] = (Complex){in[k].real, -in[k].imag};
+    }
+    in = out;
+  }
+
+  if (n <= 1) {
+    if (n == 1 && out != in) {
+      out[0] = in[0];
+    }
+  } else if (plan->m > 0) {
+    bluestein(plan, in, out);
+  } else if (plan->factor_count > 0) {
+    if (in == out) {
+      for (int k = 0; k < n; k++) {
+        plan->scratch[k] = in[k];
+      }
+      in = plan->scratch;
+    }
+    mixed_radix(out, in, n, 1, plan->factors, plan->twiddles, n);
+  } else {
+    radix2(plan, in, out);
+  }
+
+  if (inverse) {
+    for (int k = 0; k < n; k++) {
+      out[k].imag = -out[k].imag;
+    }
+  }
+}
+
+// The plan fft() used last, one per thread so fft() stays safe to call
+// from several threads at once
+_Thread_local FftPlan *fft_last_plan = NULL;
+
+// Forward transform in place. The plan is kept until a transform of
+// another size, so a series of one size plans once; anything that
+// alternates sizes should make its own plans.
+void fft(Complex *X, int n) {
+  if (fft_last_plan == NULL || fft_last_plan->n != n) {
+    fft_plan_destroy(fft_last_plan);
+    fft_last_plan = fft_plan_create(n, FFT_FORWARD);
+  }
+  fft_execute(fft_last_plan, X, X);
+}
+
+// Frees the plan fft() keeps for the calling thread
+void fft_cleanup() {
+  fft_plan_destroy(fft_last_plan);
+  fft_last_plan = NULL;
 }
 
 #ifdef TEST
+// The DFT straight from its definition, O(n^2)
+void dft(Complex *X, int n) {
+  Complex *out = (Complex *)malloc(n * sizeof(Complex));
+  for (int k = 0; k < n; k++) {
+    Complex sum = {0, 0};
+    for (int j = 0; j < n; j++) {
+      double t = -2 * M_PI * ((long long)j * k % n) / n;
+      sum.real += X[j].real * cos(t) - X[j].imag * sin(t);
+      sum.imag += X[j].real * sin(t) + X[j].imag * cos(t);
+    }
+    out[k] = sum;
+  }
+  for (int k = 0; k < n; k++) {
+    X[k] = out[k];
+  }
+  free(out);
+}
+
 int compareComplex(Complex a, Complex b, double tol) {
   return (fabs(a.real - b.real) < tol) && (fabs(a.imag - b.imag) < tol);
 }
 
+// n random values, the same ones for every call with the same n
+Complex *randomSignal(int n) {
+  Complex *signal = (Complex *)malloc(n * sizeof(Complex));
+  srand(n);
+  for (int i = 0; i < n; i++) {
+    signal[i] = (Complex){(double)rand() / RAND_MAX - 0.5,
+                          (double)rand() / RAND_MAX - 0.5};
+  }
+  return signal;
+}
+
+int compareDft(const Complex *input, const Complex *output, int n,
+               double tol) {
+  Complex *expected = (Complex *)malloc(n * sizeof(Complex));
+  for (int i = 0; i < n; i++) {
+    expected[i] = input[i];
+  }
+  dft(expected, n);
+  int equal = 1;
+  for (int i = 0; i < n; i++) {
+    equal = equal && compareComplex(output[i], expected[i], tol);
+  }
+  free(expected);
+  return equal;
+}
+
 void test_fft() {
   const double epsilon = 1e-6;
 
@@ -81,6 +403,70 @@ void test_fft() {
     }
   }
 
+  // Test case 4: Sizes that aren't a power of two
+  {
+    Complex input[] = {{1, 0}, {2, 0}, {3, 0}};
+    Complex expected[] = {{6, 0}, {-1.5, 0.8660254}, {-1.5, -0.8660254}};
+
+    fft(input, 3);
+    for (int i = 0; i < 3; i++) {
+      assert(compareComplex(input[i], expected[i], epsilon));
+    }
+  }
+
+  // Test case 5: Random signals against the definition, every size up to
+  // 128, smooth and prime, and some larger
+  {
+    int extra[] = {840, 1009, 1024, 4097, 2 * 3 * 5 * 7 * 9};
+    for (int s = 0; s < 133; s++) {
+      int n = s < 128 ? s + 1 : extra[s - 128];
+      Complex *input = randomSignal(n);
+      Complex *output = (Complex *)malloc(n * sizeof(Complex));
+      for (int i = 0; i < n; i++) {
+        output[i] = input[i];
+      }
+
+      fft(output, n);
+      assert(compareDft(input, output, n, epsilon));
+
+      free(input);
+      free(output);
+    }
+  }
+
+  // Test case 6: Plans, in and out of place, and the inverse round trip
+  {
+    int sizes[] = {1, 2, 64, 60, 97, 1000};
+    for (int s = 0; s < 6; s++) {
+      int n = sizes[s];
+      Complex *input = randomSignal(n);
+      Complex *output = (Complex *)malloc(n * sizeof(Complex));
+      FftPlan *forward = fft_plan_create(n, FFT_FORWARD);
+      FftPlan *inverse = fft_plan_create(n, FFT_INVERSE);
+
+      fft_execute(forward, input, output);
+      assert(compareDft(input, output, n, epsilon));
+
+      fft_execute(inverse, output, output);
+      for (int i = 0; i < n; i++) {
+        Complex scaled = {output[i].real / n, output[i].imag / n};
+        assert(compareComplex(scaled, input[i], epsilon));
+      }
+
+      for (int i = 0; i < n; i++) {
+        output[i] = input[i];
+      }
+      fft_execute(forward, output, output);
+      assert(compareDft(input, output, n, epsilon));
+
+      fft_plan_destroy(forward);
+      fft_plan_destroy(inverse);
+      free(input);
+      free(output);
+    }
+  }
+
+  fft_cleanup();
   printf("All tests passed!\n");
 }
 
@@ -102,10 +488,15 @@ int main() {
     n++;
   }
 
-  fft(X, n);
+  Complex *result = (Complex *)malloc((n > 0 ? n : 1) * sizeof(Complex));
+  FftPlan *plan = fft_plan_create(n, FFT_FORWARD);
+  fft_execute(plan, X, result);
+  fft_plan_destroy(plan);
+
   for (int i = 0; i < n; i++) {
-    printf("%f %f\n", X[i].real, X[i].imag);
+    printf("%f %f\n", result[i].real, result[i].imag);
   }
   free(X);
+  free(result);
 }
 #endif